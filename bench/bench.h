@@ -0,0 +1,53 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <vector>
+
+inline uint64_t bench_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Emits one JSON object per line on stdout:
+// {"bench":"parser","metric":"throughput","value":1.7e7,"unit":"tokens/s"}
+void bench_report(const char* bench, const char* metric, double value, const char* unit);
+
+// Reports <metric>_p50, <metric>_p99 and <metric>_mean from samples in
+// nanoseconds, converted to unit ("ns" or "us"). Sorts samples.
+void bench_report_latency(const char* bench, const char* metric, std::vector<uint64_t>& samples,
+                          const char* unit);
+
+// An interactive FusionShell on a pseudo-terminal, for the benches that
+// drive it like a user.
+struct PtyShell {
+    pid_t pid;
+    int master;
+};
+
+// Forks the shell with FUSIONSHELL_HISTFILE set (and FUSIONSHELL_HISTSIZE,
+// unless history_size is 0).
+bool pty_shell_start(PtyShell& shell, const char* history_file, size_t history_size = 0);
+// Kills and reaps the shell and closes the pty.
+void pty_shell_stop(PtyShell& shell);
+// Reads fd until text shows up and returns bench_now_ns() at that point,
+// or 0 if nothing arrives for timeout_ms or the pty closes.
+uint64_t pty_wait_for(int fd, const char* text, int timeout_ms);
+// Reads whatever the shell writes until it has been quiet for quiet_ms.
+void pty_drain(int fd, int quiet_ms);
+
+void bench_parser();
+void bench_suggestion();
+void bench_spawn();
+void bench_pipeline();
+void bench_keystroke();
+void bench_engine();
+void bench_startup();
+void bench_search();
+void bench_completion();
+void bench_history();
+
+#endif // BENCH_H
@@ -0,0 +1,72 @@
+#include "bench.h"
+#include "completion.h"
+#include <cstdlib>
+#include <fcntl.h>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static void remove_tree(const std::string& dir, size_t files) {
+    for (size_t i = 0; i < files; ++i) {
+        unlink((dir + "/cmd" + std::to_string(i)).c_str());
+    }
+    unlink((dir + "/freshly-installed").c_str());
+    rmdir(dir.c_str());
+}
+
+// Command completion against a PATH of one directory holding 1k, 10k and
+// 50k executables: the one-time index build, lookups for prefixes of
+// varying selectivity, and how long a newly created binary takes to
+// become completable (inotify event plus incremental update).
+void bench_completion() {
+    const char* saved = getenv("PATH");
+    std::string saved_path = saved ? saved : "";
+    for (size_t files : {1000ul, 10000ul, 50000ul}) {
+        char dir_template[] = "/tmp/fusionshell_bench_path_XXXXXX";
+        if (!mkdtemp(dir_template)) {
+            return;
+        }
+        std::string dir = dir_template;
+        for (size_t i = 0; i < files; ++i) {
+            int fd = open((dir + "/cmd" + std::to_string(i)).c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0755);
+            if (fd != -1) {
+                close(fd);
+            }
+        }
+        setenv("PATH", dir.c_str(), 1);
+        std::string suffix = "_" + std::to_string(files);
+
+        Completer completer;
+        CompletionResult result;
+        uint64_t start = bench_now_ns();
+        completer.complete_command("cmd", result);
+        bench_report("completion", ("build" + suffix).c_str(), (bench_now_ns() - start) / 1e3, "us");
+
+        std::mt19937 rng(7);
+        std::vector<uint64_t> samples;
+        for (int i = 0; i < 20000; ++i) {
+            // From "" (everything) down to one exact name.
+            std::string prefix = std::string("cmd").substr(0, rng() % 4) + std::to_string(rng() % files);
+            prefix.resize(rng() % (prefix.size() + 1));
+            CompletionResult lookup;
+            uint64_t begin = bench_now_ns();
+            completer.complete_command(prefix, lookup);
+            samples.push_back(bench_now_ns() - begin);
+        }
+        bench_report_latency("completion", ("lookup" + suffix).c_str(), samples, "ns");
+
+        start = bench_now_ns();
+        int fd = open((dir + "/freshly-installed").c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0755);
+        if (fd != -1) {
+            close(fd);
+        }
+        CompletionResult fresh;
+        completer.complete_command("fresh", fresh);
+        bench_report("completion", ("invalidate" + suffix).c_str(), (bench_now_ns() - start) / 1e3, "us");
+        bench_report("completion", ("invalidate_found" + suffix).c_str(), fresh.count, "names");
+
+        remove_tree(dir, files);
+    }
+    setenv("PATH", saved_path.c_str(), 1);
+}
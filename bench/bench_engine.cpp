@@ -0,0 +1,39 @@
+#include "bench.h"
+#include "shell_engine.h"
+#include <string>
+#include <vector>
+
+// Round trip through the embedding API with output captured in memory:
+// an in-process builtin and an external command, each also as a $(...)
+// substitution, plus capture bandwidth.
+void bench_engine() {
+    ShellEngine engine;
+    std::vector<uint64_t> samples;
+    const char* const lines[][2] = {
+        {"echo hello", "run_builtin"},
+        {"printf hello", "run_external"},
+        {"echo $(echo hello)", "subst_builtin"},
+        {"echo $(printf hello)", "subst_external"},
+    };
+    for (const auto& entry : lines) {
+        const char* line = entry[0];
+        for (int i = 0; i < 20; ++i) {
+            engine.run(line);
+        }
+        samples.clear();
+        for (int i = 0; i < 2000; ++i) {
+            uint64_t start = bench_now_ns();
+            engine.run(line);
+            samples.push_back(bench_now_ns() - start);
+        }
+        bench_report_latency("engine", entry[1], samples, "us");
+    }
+
+    std::string out;
+    std::string err;
+    out.reserve(256 << 20);
+    uint64_t start = bench_now_ns();
+    engine.run("head -c 268435456 /dev/zero", out, err);
+    uint64_t elapsed = bench_now_ns() - start;
+    bench_report("engine", "capture", static_cast<double>(out.size()) / elapsed, "GB/s");
+}
@@ -0,0 +1,102 @@
+#include "bench.h"
+#include "shared_log.h"
+#include "time_util.h"
+#include <cstdlib>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+static const int writers = 4;
+static const int appends_per_writer = 50000;
+
+// Forks the writers, each appending appends_per_writer timestamped
+// commands to file (pausing for 200us after every burst of paced ones, if
+// paced is nonzero), and has follower read along until they are done.
+static void run_writers(const char* file, SharedLog& follower, int paced, std::vector<uint64_t>& samples) {
+    std::vector<pid_t> pids;
+    for (int w = 0; w < writers; ++w) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            SharedLog log;
+            if (log.open(file, 0)) {
+                for (int i = 0; i < appends_per_writer; ++i) {
+                    if (paced != 0 && i % paced == 0) {
+                        usleep(200);
+                    }
+                    log.append(std::to_string(monotonic_ns()) + " git commit -m 'writer " + std::to_string(w) + "'");
+                }
+            }
+            _exit(0);
+        }
+        if (pid != -1) {
+            pids.push_back(pid);
+        }
+    }
+    auto receive = [&](std::string_view text) {
+        samples.push_back(monotonic_ns() - strtoull(std::string(text.substr(0, 20)).c_str(), nullptr, 10));
+    };
+    size_t exited = 0;
+    while (exited < pids.size()) {
+        follower.read_new(receive);
+        while (waitpid(-1, nullptr, WNOHANG) > 0) {
+            exited++;
+        }
+    }
+    follower.read_new(receive);
+}
+
+// Sessions sharing one history log: per-append latency with no one else
+// around; four processes appending flat out into a 1 MiB log, which
+// compacts it about ten times; and the same writers paced like people
+// running commands, with a fifth session following along. Each record
+// carries its send time, so the follower measures how long a command takes
+// to reach another session and counts what it received against what was
+// sent.
+void bench_history() {
+    char history_file[] = "/tmp/fusionshell_bench_XXXXXX";
+    int fd = mkstemp(history_file);
+    if (fd == -1) {
+        return;
+    }
+    close(fd);
+
+    {
+        SharedLog log;
+        if (!log.open(history_file, 64 * 1024 * 1024)) {
+            unlink(history_file);
+            return;
+        }
+        std::vector<uint64_t> samples;
+        for (int i = 0; i < 100000; ++i) {
+            std::string text = "make -C build target_" + std::to_string(i);
+            uint64_t start = bench_now_ns();
+            log.append(text);
+            samples.push_back(bench_now_ns() - start);
+        }
+        bench_report_latency("history", "append", samples, "ns");
+    }
+    unlink(history_file);
+
+    {
+        SharedLog follower;
+        if (follower.open(history_file, 1024 * 1024)) {
+            std::vector<uint64_t> samples;
+            uint64_t start = bench_now_ns();
+            run_writers(history_file, follower, 0, samples);
+            double seconds = (bench_now_ns() - start) / 1e9;
+            bench_report("history", "concurrent_appends", writers * appends_per_writer / seconds, "appends/s");
+        }
+    }
+    unlink(history_file);
+
+    SharedLog follower;
+    if (follower.open(history_file, 256 * 1024)) {
+        std::vector<uint64_t> samples;
+        run_writers(history_file, follower, 50, samples);
+        bench_report("history", "sent", writers * appends_per_writer, "records");
+        bench_report("history", "received", samples.size(), "records");
+        bench_report_latency("history", "propagation", samples, "us");
+    }
+    unlink(history_file);
+}
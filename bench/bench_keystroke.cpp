@@ -0,0 +1,54 @@
+#include "bench.h"
+#include <cstdlib>
+#include <poll.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Time from writing one key to the pty until the shell's repaint of the
+// line arrives: read_input, the incremental lexer, the suggestion lookup
+// and LineRenderer's single write, as a user would see it.
+void bench_keystroke() {
+    char history_file[] = "/tmp/fusionshell_bench_XXXXXX";
+    int history_fd = mkstemp(history_file);
+    if (history_fd == -1) {
+        return;
+    }
+    close(history_fd);
+
+    PtyShell shell;
+    if (!pty_shell_start(shell, history_file)) {
+        unlink(history_file);
+        return;
+    }
+    int master = shell.master;
+
+    if (pty_wait_for(master, "fusionshell> ", 2000) != 0) {
+        pty_drain(master, 50);
+        const std::string text = "echo the quick brown fox | grep fox > /dev/null";
+        std::vector<uint64_t> typing;
+        std::vector<uint64_t> erasing;
+        char buffer[4096];
+        struct pollfd pfd{master, POLLIN, 0};
+        for (int round = 0; round < 20; ++round) {
+            for (int pass = 0; pass < 2; ++pass) {
+                for (size_t i = 0; i < text.size(); ++i) {
+                    char key = pass == 0 ? text[i] : 0x7f;
+                    uint64_t start = bench_now_ns();
+                    if (write(master, &key, 1) != 1 || poll(&pfd, 1, 1000) <= 0 ||
+                        read(master, buffer, sizeof(buffer)) <= 0) {
+                        round = 20;
+                        break;
+                    }
+                    (pass == 0 ? typing : erasing).push_back(bench_now_ns() - start);
+                    pty_drain(master, 0);
+                }
+            }
+        }
+        bench_report_latency("keystroke", "insert", typing, "us");
+        bench_report_latency("keystroke", "backspace", erasing, "us");
+    }
+
+    pty_shell_stop(shell);
+    unlink(history_file);
+}
@@ -0,0 +1,60 @@
+#include "bench.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+struct BenchEntry {
+    const char* name;
+    void (*run)();
+};
+
+static const BenchEntry benches[] = {
+    {"parser", bench_parser},
+    {"suggestion", bench_suggestion},
+    {"spawn", bench_spawn},
+    {"pipeline", bench_pipeline},
+    {"keystroke", bench_keystroke},
+    {"engine", bench_engine},
+    {"startup", bench_startup},
+    {"search", bench_search},
+    {"completion", bench_completion},
+    {"history", bench_history},
+};
+
+void bench_report(const char* bench, const char* metric, double value, const char* unit) {
+    printf("{\"bench\":\"%s\",\"metric\":\"%s\",\"value\":%.6g,\"unit\":\"%s\"}\n", bench, metric, value, unit);
+    fflush(stdout);
+}
+
+void bench_report_latency(const char* bench, const char* metric, std::vector<uint64_t>& samples,
+                          const char* unit) {
+    if (samples.empty()) {
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    double scale = strcmp(unit, "us") == 0 ? 1e3 : 1.0;
+    double sum = 0;
+    for (uint64_t sample : samples) {
+        sum += sample;
+    }
+    std::string name(metric);
+    bench_report(bench, (name + "_p50").c_str(), samples[samples.size() / 2] / scale, unit);
+    bench_report(bench, (name + "_p99").c_str(), samples[samples.size() * 99 / 100] / scale, unit);
+    bench_report(bench, (name + "_mean").c_str(), sum / samples.size() / scale, unit);
+}
+
+int main(int argc, char* argv[]) {
+    for (const auto& bench : benches) {
+        bool selected = argc == 1;
+        for (int i = 1; i < argc; ++i) {
+            if (strcmp(argv[i], bench.name) == 0) {
+                selected = true;
+            }
+        }
+        if (selected) {
+            bench.run();
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,47 @@
+#include "bench.h"
+#include "parser.h"
+#include <string>
+#include <vector>
+
+void bench_parser() {
+    const std::vector<std::string> lines = {
+        "ls -la /usr/local/bin",
+        "cat access.log | grep -v healthcheck | awk '{print $7}' | sort | uniq -c | sort -rn > top.txt",
+        "find . -name \"*.cpp\" -newer build/stamp | xargs grep -n \"TODO\\: fix\" < /dev/null &",
+        "echo 'single quoted | not a pipe' \"double $HOME\" plain\\ escaped word",
+    };
+
+    size_t tokens_per_round = 0;
+    for (const auto& line : lines) {
+        ParsedCommand parsed = parse_command(line);
+        for (const auto& list : parsed.lists) {
+            for (const auto& pipeline : list) {
+                for (const auto& cmd : pipeline.commands) {
+                    tokens_per_round += cmd.tokens.size() + !cmd.input_file.empty() + !cmd.output_file.empty();
+                }
+            }
+        }
+    }
+
+    const int rounds = 200000;
+    size_t sink = 0;
+    for (const auto& line : lines) {
+        sink += parse_command(line).lists.size(); // warm up
+    }
+    uint64_t start = bench_now_ns();
+    for (int r = 0; r < rounds; ++r) {
+        for (const auto& line : lines) {
+            ParsedCommand parsed = parse_command(line);
+            sink += parsed.lists.size();
+        }
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+    if (sink == 0) {
+        return; // keeps the parse results observable
+    }
+
+    double seconds = elapsed / 1e9;
+    double tokens = static_cast<double>(tokens_per_round) * rounds;
+    bench_report("parser", "throughput", tokens / seconds, "tokens/s");
+    bench_report("parser", "per_line", static_cast<double>(elapsed) / (rounds * lines.size()), "ns");
+}
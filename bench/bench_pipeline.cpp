@@ -0,0 +1,29 @@
+#include "bench.h"
+#include "executor.h"
+#include "parser.h"
+#include "shell_context.h"
+#include <string>
+
+static double run_gbps(ShellContext& ctx, const std::string& line, double bytes) {
+    ParsedCommand parsed = parse_command(line);
+    uint64_t start = bench_now_ns();
+    execute_command(parsed, ctx);
+    uint64_t elapsed = bench_now_ns() - start;
+    return bytes / elapsed;
+}
+
+// Pushes 1 GiB through three pipes, with and without the tee relay, at
+// the kernel's default pipe size and at 1 MiB.
+void bench_pipeline() {
+    const double bytes = 1024.0 * 1024 * 1024;
+    const std::string plain = "head -c 1073741824 /dev/zero | cat | cat | cat > /dev/null";
+    const std::string relay = "head -c 1073741824 /dev/zero | tee /dev/null | cat | cat > /dev/null";
+
+    ShellContext ctx(false);
+    for (int size : {0, 1024 * 1024}) {
+        ctx.pipe_size = size;
+        std::string suffix = size == 0 ? "default" : std::to_string(size / 1024) + "k";
+        bench_report("pipeline", ("cat3_" + suffix).c_str(), run_gbps(ctx, plain, bytes), "GB/s");
+        bench_report("pipeline", ("tee_relay_" + suffix).c_str(), run_gbps(ctx, relay, bytes), "GB/s");
+    }
+}
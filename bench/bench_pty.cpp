@@ -0,0 +1,59 @@
+#include "bench.h"
+#include "fusionshell.h"
+#include <cstdlib>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+bool pty_shell_start(PtyShell& shell, const char* history_file, size_t history_size) {
+    shell.pid = forkpty(&shell.master, nullptr, nullptr, nullptr);
+    if (shell.pid == -1) {
+        return false;
+    }
+    if (shell.pid == 0) {
+        setenv("FUSIONSHELL_HISTFILE", history_file, 1);
+        if (history_size != 0) {
+            setenv("FUSIONSHELL_HISTSIZE", std::to_string(history_size).c_str(), 1);
+        }
+        FusionShell fusionshell;
+        fusionshell.run();
+        _exit(0);
+    }
+    return true;
+}
+
+void pty_shell_stop(PtyShell& shell) {
+    kill(shell.pid, SIGKILL);
+    waitpid(shell.pid, nullptr, 0);
+    close(shell.master);
+}
+
+uint64_t pty_wait_for(int fd, const char* text, int timeout_ms) {
+    std::string seen;
+    char buffer[4096];
+    struct pollfd pfd{fd, POLLIN, 0};
+    while (poll(&pfd, 1, timeout_ms) > 0) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n <= 0) {
+            return 0;
+        }
+        seen.append(buffer, n);
+        if (seen.find(text) != std::string::npos) {
+            return bench_now_ns();
+        }
+    }
+    return 0;
+}
+
+void pty_drain(int fd, int quiet_ms) {
+    char buffer[4096];
+    struct pollfd pfd{fd, POLLIN, 0};
+    while (poll(&pfd, 1, quiet_ms) > 0) {
+        if (read(fd, buffer, sizeof(buffer)) <= 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,70 @@
+#include "bench.h"
+#include "history_search.h"
+#include "time_util.h"
+#include <random>
+#include <string>
+#include <vector>
+
+static const char* const verbs[] = {"git", "make", "cmake", "ls", "grep", "cat", "ssh", "docker", "kubectl", "vim"};
+static const char* const nouns[] = {"status", "build", "push", "logs", "src", "include", "deploy", "test", "run", "diff"};
+
+// Ctrl-R scans of a 1M-entry ring with each available kernel: the time
+// for a whole scan (what ranking everything costs), and per keystroke
+// while typing a query, the first deadline-bounded slice that the prompt
+// waits for before it redraws.
+void bench_search() {
+    const size_t entries = 1000000;
+    std::mt19937 rng(42);
+    HistoryRing ring(entries, entries * 64);
+    for (size_t i = 0; i < entries; ++i) {
+        std::string cmd = verbs[rng() % 10];
+        cmd += ' ';
+        cmd += nouns[rng() % 10];
+        cmd += ' ';
+        cmd += std::to_string(rng() % 100000);
+        ring.push_back(cmd);
+    }
+    const char* const queries[] = {"g", "dkrlogs", "git push 42", "zzz"};
+    const char* const typed = "kubectl deploy 7";
+
+    SearchKernel original = search_kernel();
+    for (SearchKernel kernel : {SearchKernel::Scalar, SearchKernel::SSE2, SearchKernel::AVX2}) {
+        if (!set_search_kernel(kernel)) {
+            continue;
+        }
+        std::string name = search_kernel_name(kernel);
+        for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); ++q) {
+            std::vector<uint64_t> samples;
+            for (int run = 0; run < 10; ++run) {
+                HistorySearch search;
+                uint64_t start = bench_now_ns();
+                search.set_query(ring, queries[q]);
+                while (!search.step(ring, 0)) {
+                }
+                samples.push_back(bench_now_ns() - start);
+            }
+            bench_report_latency("search", ("full_scan_" + name + "_q" + std::to_string(q)).c_str(), samples,
+                                 "us");
+        }
+
+        std::vector<uint64_t> slices;
+        std::vector<uint64_t> totals;
+        for (int run = 0; run < 5; ++run) {
+            HistorySearch search;
+            std::string query;
+            for (const char* p = typed; *p; ++p) {
+                query += *p;
+                uint64_t start = bench_now_ns();
+                search.set_query(ring, query);
+                search.step(ring, monotonic_ns() + 500 * 1000);
+                slices.push_back(bench_now_ns() - start);
+                while (!search.step(ring, 0)) {
+                }
+                totals.push_back(bench_now_ns() - start);
+            }
+        }
+        bench_report_latency("search", ("keystroke_slice_" + name).c_str(), slices, "us");
+        bench_report_latency("search", ("keystroke_complete_" + name).c_str(), totals, "us");
+    }
+    set_search_kernel(original);
+}
@@ -0,0 +1,45 @@
+#include "bench.h"
+#include "executor.h"
+#include "parser.h"
+#include "shell_context.h"
+#include <vector>
+
+// Wall time from execute_command to the reaped exit of an external
+// command, through PATH lookup, the hash cache and launch_process; and
+// of the same command in a ( ... ) subshell, whose child execs it in
+// place.
+void bench_spawn() {
+    ShellContext ctx(false);
+    ParsedCommand cmd = parse_command("sleep 0");
+    ParsedCommand pipeline = parse_command("sleep 0 | sleep 0 | sleep 0");
+    ParsedCommand subshell = parse_command("(sleep 0)");
+    for (int i = 0; i < 50; ++i) {
+        execute_command(cmd, ctx);
+    }
+
+    const int runs = 2000;
+    std::vector<uint64_t> samples;
+    samples.reserve(runs);
+    for (int i = 0; i < runs; ++i) {
+        uint64_t start = bench_now_ns();
+        execute_command(cmd, ctx);
+        samples.push_back(bench_now_ns() - start);
+    }
+    bench_report_latency("spawn", "command", samples, "us");
+
+    samples.clear();
+    for (int i = 0; i < runs / 4; ++i) {
+        uint64_t start = bench_now_ns();
+        execute_command(pipeline, ctx);
+        samples.push_back(bench_now_ns() - start);
+    }
+    bench_report_latency("spawn", "pipeline3", samples, "us");
+
+    samples.clear();
+    for (int i = 0; i < runs / 4; ++i) {
+        uint64_t start = bench_now_ns();
+        execute_command(subshell, ctx);
+        samples.push_back(bench_now_ns() - start);
+    }
+    bench_report_latency("spawn", "subshell", samples, "us");
+}
@@ -0,0 +1,86 @@
+#include "bench.h"
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Time from fork to the first prompt of an interactive shell, and from
+// then to the first Up-arrow recall (which has to wait for the history
+// loader), with history files of growing size.
+void bench_startup() {
+    for (size_t lines : {0ul, 100000ul, 1000000ul}) {
+        char history_file[] = "/tmp/fusionshell_bench_XXXXXX";
+        int fd = mkstemp(history_file);
+        if (fd == -1) {
+            return;
+        }
+        std::string data;
+        for (size_t i = 0; i < lines; ++i) {
+            data += "make -C build target_" + std::to_string(i) + "\n";
+        }
+        if (write(fd, data.data(), data.size()) != static_cast<ssize_t>(data.size())) {
+            close(fd);
+            unlink(history_file);
+            return;
+        }
+        close(fd);
+        std::string last = lines == 0 ? "fusionshell> " : "target_" + std::to_string(lines - 1);
+
+        // One launch: fork to first prompt and Up to recall, 0 if missed.
+        auto launch = [&](uint64_t& prompt_ns, uint64_t& recall_ns) {
+            prompt_ns = 0;
+            recall_ns = 0;
+            PtyShell shell;
+            uint64_t start = bench_now_ns();
+            if (!pty_shell_start(shell, history_file, lines == 0 ? 1000 : lines)) {
+                return false;
+            }
+            uint64_t prompt = pty_wait_for(shell.master, "fusionshell> ", 10000);
+            if (prompt != 0) {
+                prompt_ns = prompt - start;
+                uint64_t recall_start = bench_now_ns();
+                if (lines > 0 && write(shell.master, "\033[A", 3) == 3) {
+                    uint64_t recall = pty_wait_for(shell.master, last.c_str(), 10000);
+                    if (recall != 0) {
+                        recall_ns = recall - recall_start;
+                    }
+                }
+            }
+            pty_shell_stop(shell);
+            return true;
+        };
+
+        std::string suffix = std::to_string(lines);
+        // The first launch converts the text file into the shared log, which
+        // later launches just map; it is reported on its own.
+        uint64_t prompt_ns;
+        uint64_t recall_ns;
+        if (!launch(prompt_ns, recall_ns)) {
+            unlink(history_file);
+            return;
+        }
+        if (prompt_ns != 0) {
+            bench_report("startup", ("import_prompt_" + suffix).c_str(), prompt_ns / 1e3, "us");
+        }
+        if (recall_ns != 0) {
+            bench_report("startup", ("import_recall_" + suffix).c_str(), recall_ns / 1e3, "us");
+        }
+
+        std::vector<uint64_t> prompt_samples;
+        std::vector<uint64_t> recall_samples;
+        for (int run = 0; run < 7 && launch(prompt_ns, recall_ns); ++run) {
+            if (prompt_ns != 0) {
+                prompt_samples.push_back(prompt_ns);
+            }
+            if (recall_ns != 0) {
+                recall_samples.push_back(recall_ns);
+            }
+        }
+        unlink(history_file);
+        // Left behind if a run was killed while importing the text file.
+        unlink((std::string(history_file) + ".tmp").c_str());
+
+        bench_report_latency("startup", ("first_prompt_" + suffix).c_str(), prompt_samples, "us");
+        bench_report_latency("startup", ("first_recall_" + suffix).c_str(), recall_samples, "us");
+    }
+}
@@ -0,0 +1,50 @@
+#include "bench.h"
+#include "history.h"
+#include <random>
+#include <string>
+#include <vector>
+
+static const char* const verbs[] = {"git", "make", "cmake", "ls", "grep", "cat", "ssh", "docker", "kubectl", "vim"};
+static const char* const nouns[] = {"status", "build", "push", "logs", "src", "include", "deploy", "test", "run", "diff"};
+
+static std::string make_command(std::mt19937& rng) {
+    std::string cmd = verbs[rng() % 10];
+    cmd += ' ';
+    cmd += nouns[rng() % 10];
+    cmd += ' ';
+    cmd += std::to_string(rng() % 100000);
+    return cmd;
+}
+
+// get_suggestion latency against memory-only histories of growing size,
+// with prefixes of 1-12 characters cut from commands in the history.
+void bench_suggestion() {
+    for (size_t entries : {1000ul, 100000ul, 1000000ul}) {
+        std::mt19937 rng(42);
+        History history(entries, "");
+        std::vector<std::string> prefixes;
+        for (size_t i = 0; i < entries; ++i) {
+            std::string cmd = make_command(rng);
+            history.add_command(cmd);
+            if (prefixes.size() < 4096 && rng() % 8 == 0) {
+                prefixes.push_back(cmd.substr(0, 1 + rng() % std::min<size_t>(cmd.size(), 12)));
+            }
+        }
+
+        const size_t queries = 200000;
+        std::vector<uint64_t> samples;
+        samples.reserve(queries);
+        size_t hits = 0;
+        for (size_t i = 0; i < queries; ++i) {
+            const std::string& prefix = prefixes[i % prefixes.size()];
+            uint64_t start = bench_now_ns();
+            std::string suggestion = history.get_suggestion(prefix);
+            samples.push_back(bench_now_ns() - start);
+            hits += !suggestion.empty();
+        }
+        std::string metric = "latency_" + std::to_string(entries);
+        bench_report_latency("suggestion", metric.c_str(), samples, "ns");
+        bench_report("suggestion", ("hit_rate_" + std::to_string(entries)).c_str(),
+                     static_cast<double>(hits) / queries, "ratio");
+    }
+}
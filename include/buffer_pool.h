@@ -0,0 +1,19 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <string>
+#include <vector>
+
+// Recycles capture and expansion buffers so repeated $(...) and engine
+// runs stop allocating once warm. acquire() returns an empty string
+// that keeps the capacity of its previous use.
+class BufferPool {
+private:
+    std::vector<std::string> spare;
+
+public:
+    std::string acquire();
+    void release(std::string&& buffer);
+};
+
+#endif // BUFFER_POOL_H
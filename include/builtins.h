@@ -0,0 +1,36 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include "shell_context.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Builtins buffer their output; the executor sends it to wherever the
+// stage's stdout/stderr point once the builtin returns. Streaming
+// builtins read in_fd and write out_fd directly instead.
+struct BuiltinIO {
+    std::string out;
+    std::string err;
+    int in_fd = 0;
+    int out_fd = 1;
+};
+
+using BuiltinFn = int (*)(ShellContext& ctx, const std::vector<std::string_view>& args, BuiltinIO& io);
+
+struct Builtin {
+    std::string_view name;
+    BuiltinFn run;
+    // Runs in a forked child even on its own, so it can be interrupted
+    // while it streams.
+    bool streams = false;
+    // Leaves shell state alone, so $(...) may run it in-process.
+    bool pure = false;
+};
+
+// Constant-time lookup through a perfect hash computed at compile time.
+const Builtin* find_builtin(std::string_view name);
+// Every builtin name, in table order (for completion).
+void list_builtins(std::vector<std::string_view>& names);
+
+#endif // BUILTINS_H
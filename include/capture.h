@@ -0,0 +1,14 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "parser.h"
+#include "shell_context.h"
+#include <string>
+
+// Runs parsed with its stdout (and stderr, if err is given) redirected
+// into pipes that a helper thread drains into the strings while the job
+// runs, so output of any size is captured without temp files. Output is
+// appended. Returns the exit status.
+int execute_captured(const ParsedCommand& parsed, ShellContext& ctx, std::string& out, std::string* err);
+
+#endif // CAPTURE_H
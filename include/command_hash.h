@@ -0,0 +1,32 @@
+#ifndef COMMAND_HASH_H
+#define COMMAND_HASH_H
+
+#include <string>
+#include <unordered_map>
+
+struct HashEntry {
+    std::string path;
+    unsigned long hits;
+};
+
+// Remembers where commands were found on $PATH, like bash's `hash`.
+// The table is dropped whenever PATH changes.
+class CommandHash {
+private:
+    std::unordered_map<std::string, HashEntry> entries;
+    std::string path_snapshot;
+
+    void check_path();
+    static std::string search_path(const std::string& name, const std::string& path);
+
+public:
+    // Absolute (or slash-containing) path for name, or "" if not found.
+    std::string lookup(const std::string& name);
+    bool add(const std::string& name);
+    void set(const std::string& name, const std::string& path);
+    bool forget(const std::string& name);
+    void clear();
+    void print(std::string& out) const;
+};
+
+#endif // COMMAND_HASH_H
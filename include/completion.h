@@ -0,0 +1,105 @@
+#ifndef COMPLETION_H
+#define COMPLETION_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// What one Tab press found for a word.
+struct CompletionResult {
+    // The longest prefix shared by every candidate, as the whole word
+    // (directory part included), unescaped.
+    std::string common;
+    size_t count = 0;
+    // The first max_shown candidate names; directories end in '/'.
+    std::vector<std::string> shown;
+    // The only candidate is a directory, so no space should follow it.
+    bool directory = false;
+};
+
+// Tab-completion index. Command names from every $PATH directory, plus
+// the builtins, live in one sorted array that counts how many directories
+// provide each name; file completion lists a directory once and caches the
+// sorted listing. A single inotify descriptor keeps both current -- PATH
+// entries are added or dropped one name at a time, cached listings are
+// discarded when their directory changes -- so a lookup is two binary
+// searches however many binaries PATH holds, and nothing is re-read on
+// each Tab.
+//
+// The PATH index is built on first use, or ahead of it on a thread by
+// warm_up(), and rebuilt when PATH changes. Register fd() with the event
+// loop and call handle_events() when it is readable; lookups also drain it
+// first.
+class Completer {
+public:
+    static const size_t max_shown = 100;
+
+private:
+    struct Name {
+        std::string name;
+        bool directory;
+        // For commands: how many PATH directories (or the builtin table)
+        // provide the name; it goes when the last one does.
+        uint32_t sources;
+    };
+
+    struct WatchedDir {
+        std::string path;
+        bool on_path = false;
+        std::unordered_set<std::string> commands;
+        bool listed = false;
+        uint64_t last_used = 0;
+        // Dot files are kept apart so an empty prefix is still one range.
+        std::vector<Name> visible;
+        std::vector<Name> hidden;
+    };
+
+    int inotify_fd;
+    bool indexed;
+    std::string path_snapshot;
+    std::vector<Name> commands;
+    std::unordered_map<int, WatchedDir> watches;
+    std::unordered_map<std::string, int> listings;
+    uint64_t use_clock;
+    // Ids handed out in place of watch descriptors when inotify is
+    // unavailable; the index is then rebuilt on every lookup.
+    int unwatched_id;
+    std::thread indexer;
+
+    static void collect(const std::vector<Name>& names, std::string_view prefix, std::string_view dir_part,
+                        CompletionResult& result);
+    void wait_for_index();
+    void check_path();
+    void build_path_index();
+    int watch(const std::string& path);
+    void unwatch(int wd);
+    void add_command(const std::string& name);
+    void remove_command(const std::string& name);
+    void refresh_command(WatchedDir& dir, const std::string& name);
+    void drop_path_dir(WatchedDir& dir);
+    void drop_listing(WatchedDir& dir);
+    void reset();
+    WatchedDir* listing(const std::string& path);
+
+public:
+    Completer();
+    ~Completer();
+    Completer(const Completer&) = delete;
+    Completer& operator=(const Completer&) = delete;
+
+    int fd() const { return inotify_fd; }
+    // Starts indexing the current PATH in the background unless that has
+    // been done already; every other call waits for it to finish.
+    void warm_up();
+    void handle_events();
+
+    void complete_command(std::string_view prefix, CompletionResult& result);
+    // word may hold a directory part ("src/ma", "~/.con", "/usr/b").
+    void complete_file(std::string_view word, CompletionResult& result);
+};
+
+#endif // COMPLETION_H
@@ -0,0 +1,52 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <cstdint>
+#include <functional>
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <unordered_map>
+#include <unordered_set>
+
+// epoll-based loop multiplexing file descriptors, timerfd timers and
+// signals delivered through a signalfd (the signals stay blocked, so no
+// handler ever runs in signal context).
+class EventLoop {
+public:
+    using FdCallback = std::function<void(uint32_t events)>;
+    using SignalCallback = std::function<void(const signalfd_siginfo& info)>;
+
+private:
+    int epoll_fd;
+    int signal_fd;
+    sigset_t signal_mask;
+    std::unordered_map<int, FdCallback> fd_callbacks;
+    std::unordered_map<int, SignalCallback> signal_callbacks;
+    std::unordered_set<int> timers;
+
+    void dispatch_signals();
+
+public:
+    EventLoop();
+    ~EventLoop();
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    bool add_fd(int fd, uint32_t events, FdCallback callback);
+    void remove_fd(int fd);
+
+    // Creates a disarmed timer; returns its id or -1.
+    int add_timer(std::function<void()> callback);
+    // interval_ms 0 makes it one-shot; delay_ms 0 disarms it.
+    void arm_timer(int timer, uint64_t delay_ms, uint64_t interval_ms = 0);
+    void remove_timer(int timer);
+
+    // Blocks signo for the whole process and routes it to callback.
+    bool watch_signal(int signo, SignalCallback callback);
+
+    // Waits up to timeout_ms (-1 forever) and runs ready callbacks.
+    // Returns the number of events handled.
+    int run_once(int timeout_ms);
+};
+
+#endif // EVENT_LOOP_H
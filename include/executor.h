@@ -2,8 +2,13 @@
 #define EXECUTOR_H
 
 #include "parser.h"
-#include "job_control.h"
+#include "shell_context.h"
 
-void execute_command(const ParsedCommand& cmd, bool& running, JobControl& job_control);
+// Runs the line's lists, skipping pipelines whose "&&" or "||" does not
+// hold. Returns the exit status of the last pipeline that ran (128+n if
+// killed or stopped). exec_tail says nothing runs after the line in this
+// process, as for `-c`, so a simple external command that would be the
+// last to run replaces the shell instead of being forked.
+int execute_command(const ParsedCommand& cmd, ShellContext& ctx, bool exec_tail = false);
 
 #endif // EXECUTOR_H
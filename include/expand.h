@@ -0,0 +1,30 @@
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include "parser.h"
+#include "shell_context.h"
+#include <string>
+#include <vector>
+
+// Commands with every $(...) and `...` replaced by its output. The
+// final words live in arena, a buffer borrowed from ctx.buffers.
+struct Expansion {
+    std::vector<Command> commands;
+    std::string arena;
+};
+
+bool has_substitutions(const std::vector<Command>& commands);
+
+// Runs each substitution, trims its trailing newlines and splits
+// unquoted output on whitespace, then rebuilds the words. Returns false
+// if the expanded line has no command left to run.
+bool expand_substitutions(const std::vector<Command>& commands, ShellContext& ctx, Expansion& expansion);
+
+// Hands the arena back to ctx.buffers.
+void release_expansion(Expansion& expansion, ShellContext& ctx);
+
+// Output of source with trailing newlines removed. A lone pure builtin
+// runs in-process; anything else goes through a capture pipe.
+int capture_output(std::string_view source, ShellContext& ctx, std::string& out);
+
+#endif // EXPAND_H
@@ -1,42 +1,67 @@
 #ifndef FUSIONSHELL_H
 #define FUSIONSHELL_H
 
-#include "job_control.h"
+#include "completion.h"
+#include "event_loop.h"
+#include "history.h"
+#include "history_search.h"
+#include "input_decoder.h"
+#include "lexer.h"
+#include "line_renderer.h"
+#include "shell_context.h"
+#include <istream>
+#include <optional>
 #include <string>
 #include <vector>
 
-class History {
-private:
-    std::vector<std::string> commands;
-    size_t max_size;
-    size_t current_index;
-    std::string history_file;
-
-    void load_history();
-    void save_history();
-
-public:
-    History();
-    void add_command(const std::string& cmd);
-    std::string get_prev_command();
-    std::string get_next_command();
-    std::string get_suggestion(const std::string& prefix);
-};
-
 class FusionShell {
 private:
-    bool running;
-    JobControl job_control;
+    ShellContext ctx;
     History history;
+    IncrementalLexer lexer;
+    LineRenderer renderer;
+    InputDecoder decoder;
+    EventLoop events;
+    HistorySearch search;
+    // Only an interactive shell has a prompt to complete at, so batch
+    // shells never pay for the inotify instance.
+    std::optional<Completer> completer;
+    bool tab_pressed;
+    bool searching;
+    size_t search_pick;
+    std::string search_saved;
+    int escape_timer;
+    bool escape_timed_out;
+    bool input_closed;
 
     void setup_signal_handlers();
     void enable_raw_mode();
     void disable_raw_mode();
     std::string read_input();
+    bool apply_key(const Key& key, std::string& input, size_t& cursor_pos);
+    bool apply_search_key(const Key& key, std::string& input, size_t& cursor_pos);
+    void show_search_pick(std::string& input, size_t& cursor_pos);
+    std::string search_prompt() const;
+    void show_notifications();
+    void complete_word(std::string& input, size_t& cursor_pos, bool list);
+    void insert_text(std::string& input, size_t& cursor_pos, const std::string& text);
+
+    void execute_line(const std::string& input, bool exec_tail = false);
+    void run_script_line(const std::string& line, bool exec_tail);
 
 public:
-    FusionShell();
-    void run();
+    // A non-interactive shell leaves the terminal, signals and history
+    // alone; it is driven through run_script.
+    explicit FusionShell(bool interactive = true);
+    // Runs the interactive loop until exit; returns the last status.
+    int run();
+    // Runs each line of in; returns the status of the last command. With
+    // exec_last (for -c), the last line's final command may replace the
+    // shell process instead of being forked.
+    int run_script(std::istream& in, bool exec_last = false);
+    // Like run_script, but reads fd one byte at a time so commands that
+    // read the same fd (e.g. piped stdin) see everything after their line.
+    int run_script_fd(int fd);
 };
 
 #endif // FUSIONSHELL_H
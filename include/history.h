@@ -0,0 +1,56 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "history_ring.h"
+#include "prefix_index.h"
+#include "shared_log.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+// Command history kept in a SharedLog, so every session on the host
+// appends to the same file and sees the others' commands: sync() pulls in
+// whatever they ran since it was last called. The file is sized at 128
+// bytes per entry of capacity, and never less than 1 MiB.
+//
+// The log is mapped and indexed on a background thread so the first
+// prompt never waits for it; every accessor joins the loader before
+// touching the entries.
+class History {
+private:
+    HistoryRing commands;
+    size_t current_index;
+    std::string history_file;
+    SharedLog log;
+    PrefixIndex prefix_index;
+    std::thread loader;
+    std::atomic<bool> loaded;
+
+    void wait_until_loaded();
+    void load_history();
+    void insert(std::string_view cmd);
+    void evict_front();
+
+public:
+    // Capacity and file come from FUSIONSHELL_HISTSIZE and
+    // FUSIONSHELL_HISTFILE, defaulting to 1000 and ~/.fusionshell_history.
+    History();
+    // An empty file keeps history in memory only.
+    History(size_t capacity, const std::string& file);
+    ~History();
+    History(const History&) = delete;
+    History& operator=(const History&) = delete;
+
+    void add_command(const std::string& cmd);
+    // Takes in commands other sessions have added since the last call and
+    // returns whether there were any. Does nothing while still loading.
+    bool sync();
+    std::string get_prev_command();
+    std::string get_next_command();
+    std::string get_suggestion(const std::string& prefix);
+    // The live entries, oldest first, for HistorySearch.
+    const HistoryRing& entries();
+};
+
+#endif // HISTORY_H
@@ -0,0 +1,60 @@
+#ifndef HISTORY_RING_H
+#define HISTORY_RING_H
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+// Fixed-capacity ring of history entries whose text lives back to back in
+// one circular byte arena. Pushing costs O(1) and allocates nothing unless
+// a single entry is larger than the whole arena. Storage is left
+// uninitialised, so a large capacity costs nothing until it is used.
+//
+// The arena is followed by read_padding readable bytes, so scanning code
+// may load whole vectors past the end of any entry returned by at().
+class HistoryRing {
+private:
+    struct Slot {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    size_t slot_count;
+    std::unique_ptr<char[]> arena;
+    size_t arena_size;
+    size_t head;
+    size_t count;
+    size_t write_pos;
+    uint64_t base_seq;
+
+    bool place(size_t len, size_t& pos) const;
+    void grow_arena(size_t len);
+
+public:
+    static const size_t read_padding = 64;
+
+    HistoryRing(size_t capacity, size_t arena_bytes);
+
+    size_t capacity() const { return slot_count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    // Sequence number of the oldest live entry; entry i has base + i.
+    uint64_t front_seq() const { return base_seq; }
+
+    std::string_view at(size_t i) const;
+    std::string_view front() const { return at(0); }
+    std::string_view back() const { return at(count - 1); }
+
+    // Grows the arena (keeping every entry) if len would not fit at all.
+    void ensure_fits(size_t len);
+    // True if text of this length can be pushed without evicting.
+    bool has_room(size_t len) const;
+    // Evicts from the front as needed; call has_room/pop_front first when
+    // the caller must see the evicted entries.
+    void push_back(std::string_view cmd);
+    void pop_front();
+    void clear();
+};
+
+#endif // HISTORY_RING_H
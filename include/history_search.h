@@ -0,0 +1,69 @@
+#ifndef HISTORY_SEARCH_H
+#define HISTORY_SEARCH_H
+
+#include "history_ring.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class SearchKernel {
+    Scalar,
+    SSE2,
+    AVX2,
+};
+
+// The best kernel the CPU supports is picked on first use; set_search_kernel
+// forces another one (for benchmarking) and fails if it is unavailable.
+SearchKernel search_kernel();
+bool set_search_kernel(SearchKernel kernel);
+const char* search_kernel_name(SearchKernel kernel);
+
+struct SearchMatch {
+    uint64_t seq;
+    int score;
+};
+
+// Ctrl-R search over a HistoryRing. A query matches an entry when its
+// characters appear in order (case-insensitively unless the query has an
+// uppercase letter); contiguous runs, word starts and short entries score
+// higher, and newer entries win ties, so a plain substring ranks first.
+//
+// Entries are scanned newest first in slices bounded by a deadline, so a
+// caller can render partial results and keep reading keys. A query that
+// extends the previous one only rescans the previous matches. The ring
+// must not change while a search is open.
+class HistorySearch {
+public:
+    static const size_t max_results = 256;
+
+private:
+    std::string text;
+    std::string scanned_text;
+    std::vector<uint64_t> candidates;
+    std::vector<uint64_t> matched;
+    std::vector<SearchMatch> best;
+    bool refining;
+    bool done;
+    size_t next;
+    size_t total;
+
+    void offer(const HistoryRing& ring, uint64_t seq, int score);
+
+public:
+    HistorySearch();
+    // Forgets everything, including the matches a refinement would reuse.
+    void reset();
+    void set_query(const HistoryRing& ring, std::string_view query);
+    // Scans until finished or until monotonic_ns() passes deadline_ns
+    // (at least one slice either way); true once finished.
+    bool step(const HistoryRing& ring, uint64_t deadline_ns);
+    bool finished() const { return done; }
+    const std::string& query() const { return text; }
+    // Matches found so far, in total and the top max_results best first
+    // (repeated commands appear once among the results).
+    size_t match_count() const { return matched.size(); }
+    const std::vector<SearchMatch>& results() const { return best; }
+};
+
+#endif // HISTORY_SEARCH_H
@@ -0,0 +1,53 @@
+#ifndef INPUT_DECODER_H
+#define INPUT_DECODER_H
+
+#include <string>
+
+enum class KeyType {
+    Char,
+    Enter,
+    Tab,
+    Backspace,
+    CtrlC,
+    CtrlG,
+    CtrlR,
+    Up,
+    Down,
+    Right,
+    Left,
+    Paste,
+    Escape,
+    Other,
+};
+
+struct Key {
+    KeyType type;
+    char ch;
+};
+
+// Turns raw terminal bytes into keys. Bytes are fed in whatever chunks
+// read() returned; sequences split across chunks are held back until the
+// rest arrives. Text between ESC[200~ and ESC[201~ (bracketed paste)
+// comes out as one Paste key whose text is in paste_text().
+class InputDecoder {
+private:
+    std::string pending;
+    size_t consumed;
+    bool in_paste;
+    std::string paste;
+
+    void compact();
+
+public:
+    InputDecoder();
+    void feed(const char* data, size_t len);
+    // False when the buffered bytes do not yet hold a complete key.
+    bool next(Key& key);
+    // A lone ESC is buffered that may or may not start a sequence.
+    bool has_partial() const;
+    // Gives up waiting for the rest of a sequence.
+    bool flush_partial(Key& key);
+    const std::string& paste_text() const { return paste; }
+};
+
+#endif // INPUT_DECODER_H
@@ -0,0 +1,14 @@
+#ifndef IO_UTIL_H
+#define IO_UTIL_H
+
+#include <cstddef>
+#include <string_view>
+
+// write() until everything is out, retrying on EINTR.
+bool write_all(int fd, const char* data, size_t len);
+
+inline bool write_all(int fd, std::string_view text) {
+    return write_all(fd, text.data(), text.size());
+}
+
+#endif // IO_UTIL_H
@@ -1,34 +1,93 @@
 #ifndef JOB_CONTROL_H
 #define JOB_CONTROL_H
 
+#include <cstdint>
 #include <string>
+#include <unordered_map>
 #include <vector>
-#include <map>
+#include <sys/resource.h>
+#include <sys/types.h>
 
-struct Job {
+struct Process {
     pid_t pid;
+    std::string name;
+    bool completed;
+    bool stopped;
+    int status;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    struct rusage usage; // from wait4, valid once completed
+};
+
+// One pipeline: its process group, every member process and the command
+// line that started it.
+struct Job {
     int job_id;
+    pid_t pgid;
     std::string command;
+    std::vector<Process> processes;
+    size_t completed_count;
+    size_t stopped_count;
     bool is_background;
-    bool is_stopped;
+    bool owns_group; // pgid is a real process group we can signal
+    uint64_t start_ns;
+
+    bool is_completed() const { return completed_count == processes.size(); }
+    bool is_stopped() const { return !is_completed() && completed_count + stopped_count == processes.size(); }
 };
 
 class JobControl {
 private:
-    std::map<pid_t, Job> jobs;
+    std::unordered_map<int, Job> jobs;
+    std::unordered_map<pid_t, int> jobs_by_pgid;
+    std::unordered_map<pid_t, int> jobs_by_pid;
     int next_job_id;
+    int current_job;
     pid_t shell_pgid;
+    bool interactive;
+    std::string notifications;
+
+    bool update_process(pid_t pid, int status, const struct rusage& usage, Job*& job);
 
 public:
-    JobControl();
-    void add_job(pid_t pid, const std::string& command);
-    void remove_job(pid_t pid);
-    void print_jobs();
-    void set_foreground(pid_t pid);
-    void handle_child_signal(pid_t pid, int status);
+    explicit JobControl(bool interactive = true);
+    bool is_interactive() const { return interactive; }
+    // In the forked child of a ( ... ) stage: the parent's jobs are not
+    // ours, and process groups and the terminal are the parent's to manage.
+    void enter_subshell();
+
+    // own_group: pgid is a group of its own that may be given the terminal;
+    // false when the job runs in the shell's group.
+    Job& create_job(pid_t pgid, const std::string& command, bool is_background, bool own_group);
+    void add_process(Job& job, pid_t pid, const std::string& name);
+    void remove_job(int job_id);
     Job* find_job_by_id(int job_id);
+    Job* find_job_by_pgid(pid_t pgid);
+    // The job fg/bg act on when given no argument.
+    Job* find_current_job();
+    // verbose (jobs -l) adds a resource line per process.
+    void print_jobs(std::string& out, bool verbose = false) const;
+
+    // Hands the terminal to the job (continuing it if stopped) and blocks
+    // until it completes or stops. Returns the last process's status
+    // (128+n if killed or stopped); a completed job is removed after
+    // being copied to finished, if given.
+    int wait_for_job(Job& job, bool resume, Job* finished = nullptr);
+    void continue_in_background(Job& job);
+    void handle_child_signal(pid_t pid, int status, const struct rusage& usage);
     void restore_terminal_control();
+    // Collects every child that changed state without blocking. Called
+    // from the event loop on SIGCHLD, or between lines in batch mode.
+    void reap_children();
+    // Like reap_children, but only waits on this table's own pids, for
+    // hosts that have children of their own.
+    void reap_jobs();
+    // "[n] Done cmd"-style lines queued since the last call.
+    std::string take_notifications();
 };
 
-#endif // JOB_CONTROL_H
+// Per-process wall/user/sys time, max RSS, context switches and page
+// faults, plus the job total. Used by `time` and `jobs -l`.
+void format_job_usage(const Job& job, std::string& out);
 
+#endif // JOB_CONTROL_H
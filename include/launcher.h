@@ -0,0 +1,32 @@
+#ifndef LAUNCHER_H
+#define LAUNCHER_H
+
+#include <functional>
+#include <sys/types.h>
+
+// One pipeline stage ready to exec. stdin_fd/stdout_fd/stderr_fd are
+// dup2'd onto 0/1/2 in the child; every other descriptor the shell owns
+// must be O_CLOEXEC.
+struct LaunchSpec {
+    const char* path; // resolved executable; argv[0] is passed unchanged
+    char* const* argv;
+    int stdin_fd;
+    int stdout_fd;
+    int stderr_fd;
+    pid_t pgid; // 0 starts a new process group led by the child, -1 inherits
+    // If set, a forked child runs this (e.g. a builtin inside a pipeline)
+    // and exits with its result instead of exec'ing path.
+    std::function<int()> body;
+};
+
+// Starts the stage with posix_spawn and falls back to fork/execvp for the
+// cases spawn cannot express. Returns -1 with errno set on failure.
+pid_t launch_process(const LaunchSpec& spec);
+
+// Turns the calling process itself into the stage (body is ignored):
+// launch_process without the fork, for a command nothing else in this
+// process has to wait for. Returns -1 with errno set if the exec fails,
+// by which point the standard descriptors have already been replaced.
+int exec_process(const LaunchSpec& spec);
+
+#endif // LAUNCHER_H
@@ -0,0 +1,43 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class TokenClass : uint8_t {
+    Command,
+    Argument,
+    Operator,
+    File,
+};
+
+struct LexToken {
+    size_t start;
+    size_t end;
+    TokenClass cls;
+    uint8_t state_before;
+    uint8_t state_after;
+};
+
+// Highlighting lexer for the line editor. It classifies spans of the raw
+// line (spacing preserved) and, after an edit, re-lexes only from the
+// token touching the edit until the token stream lines up with the old
+// one again.
+class IncrementalLexer {
+private:
+    std::vector<LexToken> tokens;
+    std::vector<LexToken> scratch;
+
+    static bool lex_one(const std::string& line, size_t& pos, uint8_t& state, LexToken& token);
+
+public:
+    void reset(const std::string& line);
+    // The bytes [start, start + old_len) were replaced by new_len bytes.
+    void update(const std::string& line, size_t start, size_t old_len, size_t new_len);
+    const std::vector<LexToken>& get_tokens() const { return tokens; }
+    // The class a word starting at pos has, or would have if typed there.
+    TokenClass class_at(size_t pos) const;
+};
+
+#endif // LEXER_H
@@ -0,0 +1,40 @@
+#ifndef LINE_RENDERER_H
+#define LINE_RENDERER_H
+
+#include "lexer.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Paints the prompt line. Each frame is built as a row of colored cells,
+// diffed against what is already on screen, and only the changed tail is
+// emitted with a single write().
+class LineRenderer {
+private:
+    struct Cell {
+        char ch;
+        uint8_t color;
+        bool operator!=(const Cell& other) const { return ch != other.ch || color != other.color; }
+    };
+
+    int fd;
+    std::string frame;
+    std::vector<Cell> painted;
+    std::vector<Cell> next;
+
+    void append_color(uint8_t color);
+    void flush_frame();
+
+public:
+    explicit LineRenderer(int out_fd);
+    void render(std::string_view prompt, const std::string& line, const std::vector<LexToken>& tokens,
+                std::string_view suggestion, size_t cursor);
+    // The cursor is at column 0 of a fresh line; the next render repaints
+    // everything.
+    void reset();
+    // Writes text (e.g. "\r\n") and forgets what was on screen.
+    void write_raw(std::string_view text);
+};
+
+#endif // LINE_RENDERER_H
@@ -0,0 +1,53 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <cstdint>
+
+// Diagnostic logging. Records go into a preallocated lock-free ring and
+// are written out by log_flush() from the main loop, so logging is safe
+// from signal handlers and event callbacks and costs no syscall at the
+// call site. Nothing is kept unless FUSIONSHELL_LOG names a level
+// (debug, info, warn, error); FUSIONSHELL_LOG_FILE redirects the output
+// from stderr to a file.
+//
+// Levels below FUSIONSHELL_LOG_MIN_LEVEL are compiled out entirely.
+
+enum LogLevel {
+    LOG_DEBUG = 0,
+    LOG_INFO = 1,
+    LOG_WARN = 2,
+    LOG_ERROR = 3,
+    LOG_OFF = 4,
+};
+
+#ifndef FUSIONSHELL_LOG_MIN_LEVEL
+#define FUSIONSHELL_LOG_MIN_LEVEL LOG_DEBUG
+#endif
+
+extern int log_threshold;
+
+inline bool log_enabled(LogLevel level) {
+    return level >= log_threshold;
+}
+
+// Reads FUSIONSHELL_LOG / FUSIONSHELL_LOG_FILE.
+void log_init();
+// Formats into the ring. Only %s, %d, %ld, %u, %lu, %zu, %x and %%
+// are understood: the formatter avoids stdio to stay signal-safe.
+void log_write(LogLevel level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+// Writes out everything recorded since the last flush.
+void log_flush();
+
+#define FS_LOG(level, ...)                                                 \
+    do {                                                                   \
+        if ((level) >= FUSIONSHELL_LOG_MIN_LEVEL && log_enabled(level)) { \
+            log_write(level, __VA_ARGS__);                                 \
+        }                                                                  \
+    } while (0)
+
+#define LOG_DEBUGF(...) FS_LOG(LOG_DEBUG, __VA_ARGS__)
+#define LOG_INFOF(...) FS_LOG(LOG_INFO, __VA_ARGS__)
+#define LOG_WARNF(...) FS_LOG(LOG_WARN, __VA_ARGS__)
+#define LOG_ERRORF(...) FS_LOG(LOG_ERROR, __VA_ARGS__)
+
+#endif // LOG_H
@@ -0,0 +1,20 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "builtins.h"
+
+// parallel [-j jobs] [-k] command [args...] [::: inputs...]
+//
+// Runs the command once per input (the ::: words, or else the lines of
+// stdin), with "{}" in the arguments replaced by the input or the input
+// appended when no argument mentions it. Up to -j children (default:
+// online CPUs) run at once on worker threads that pull from their own
+// deque and steal from the others when it runs dry. Each child's stdout
+// is collected and written in one piece, in input order with -k.
+//
+// Registered as a streaming builtin, so the coordinator is a forked
+// child and the whole batch shares one process group: one job to fg,
+// bg, stop or interrupt. Returns the number of failed runs, capped at 101.
+int builtin_parallel(ShellContext& ctx, const std::vector<std::string_view>& args, BuiltinIO& io);
+
+#endif // PARALLEL_H
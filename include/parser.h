@@ -1,14 +1,71 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
+// A $(...) or `...` inside a word. The word is stored without it; the
+// captured output is spliced in at offset when the stage runs.
+struct Substitution {
+    enum Target { Token, InputFile, OutputFile } target;
+    size_t token; // index into tokens when target is Token
+    size_t offset;
+    std::string_view command; // inner source, backtick escapes removed
+    bool quoted; // inside "...": spliced as is, no word splitting
+};
+
+// Words are views into the ParsedCommand's arena and are NUL-terminated,
+// so tokens[i].data() can be handed straight to exec as argv[i].
+struct Command {
+    std::vector<std::string_view> tokens;
+    std::string_view input_file;
+    std::string_view output_file;
+    bool is_background = false;
+    std::vector<Substitution> substitutions; // in word order
+    // For a ( ... ) stage, the index in ParsedCommand::lists of the list
+    // it runs in a subshell, with tokens empty; 0 for a simple command.
+    size_t subshell = 0;
+};
+
+// How a pipeline depends on the exit status of the one before it.
+enum class Connector {
+    Always, // first in its list, or after ';' or '&'
+    IfSuccess, // after "&&"
+    IfFailure, // after "||"
+};
+
+struct Pipeline {
+    std::vector<Command> commands;
+    Connector connector = Connector::Always;
+    std::string_view text; // its source, for job names
+};
+
+// Move-only: the views in lists point into arena, which also holds a copy
+// of the source line for text.
 struct ParsedCommand {
-    std::vector<std::string> tokens;
-    bool is_background;
+    std::unique_ptr<char[]> arena;
+    std::string_view text;
+    // lists[0] is the line itself; the others are bodies of ( ... ).
+    std::vector<std::vector<Pipeline>> lists;
+    const char* error = nullptr; // set, with lists empty, for a malformed line
+
+    bool empty() const { return lists.empty() || lists[0].empty(); }
+    // The command, if the line is a single simple command.
+    const Command* single_command() const {
+        return lists.size() == 1 && lists[0].size() == 1 && lists[0][0].commands.size() == 1
+                   ? &lists[0][0].commands[0]
+                   : nullptr;
+    }
 };
 
-ParsedCommand parse_command(const std::string& input);
+// Parses a line into lists of pipelines joined by ';', '&', "&&" and
+// "||", with ( ... ) grouping. Handles '...' and "..." quoting and
+// backslash escapes; quoted operators are ordinary characters. $(...) and
+// `...` (nestable) are recorded as Substitutions. A background and-or
+// list of more than one pipeline ("a && b &") becomes one background
+// ( ... ) stage.
+ParsedCommand parse_command(std::string_view input);
 
 #endif // PARSER_H
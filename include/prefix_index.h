@@ -0,0 +1,36 @@
+#ifndef PREFIX_INDEX_H
+#define PREFIX_INDEX_H
+
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Trie over history entries. Every node remembers the newest sequence
+// number that passes through it, so a lookup is one walk down the prefix
+// and yields the most recent match.
+class PrefixIndex {
+private:
+    struct Node {
+        uint64_t latest;
+        std::vector<std::pair<char, uint32_t>> children;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> free_nodes;
+
+    uint32_t child(uint32_t node, char c) const;
+    uint32_t alloc_node(uint64_t seq);
+    void free_subtree(uint32_t node);
+
+public:
+    PrefixIndex();
+    // seq must increase with every insert.
+    void insert(std::string_view cmd, uint64_t seq);
+    // Called when the oldest live entry is evicted.
+    void erase(std::string_view cmd, uint64_t seq);
+    bool find(std::string_view prefix, uint64_t& seq) const;
+    void clear();
+};
+
+#endif // PREFIX_INDEX_H
@@ -0,0 +1,17 @@
+#ifndef RELAY_H
+#define RELAY_H
+
+#include <vector>
+
+// Resizes a pipe's buffer with F_SETPIPE_SZ; size 0 leaves it alone.
+// Returns false with errno set if the kernel refuses (EPERM above
+// /proc/sys/fs/pipe-max-size for unprivileged users).
+bool set_pipe_size(int fd, int size);
+
+// Copies in_fd to every fd in outs until EOF. When in_fd is a pipe the
+// data never enters user space: tee(2) duplicates it into a scratch
+// pipe per extra output and splice(2) moves it on; outputs that refuse
+// splice (O_APPEND files, some ttys) fall back to read/write.
+bool relay_fanout(int in_fd, const std::vector<int>& outs);
+
+#endif // RELAY_H
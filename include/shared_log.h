@@ -0,0 +1,61 @@
+#ifndef SHARED_LOG_H
+#define SHARED_LOG_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+
+// Command log shared by every session on the host through a MAP_SHARED
+// mapping of the history file. An append reserves space with an atomic
+// add on the header's tail, fills in the record and publishes it with a
+// release store of its sealed length word, so appending and reading never
+// take a lock. Each session follows the log from its own read position
+// and picks up other sessions' commands without re-reading the file.
+//
+// When the log fills, the writer that overflowed takes flock() on the file
+// -- the only lock, and only then -- closes it to further appends, copies
+// the newest half into a new file and renames that over the path. Readers
+// drain the old file and then continue in the new one. A command longer
+// than a quarter of the log grows it the same way, up to 1 GiB.
+class SharedLog {
+private:
+    std::string path;
+    int fd;
+    char* map;
+    uint64_t capacity;
+    ino_t inode;
+    uint64_t session;
+    uint64_t read_pos;
+    // A record that stays reserved but uncommitted this long was left by
+    // a writer that died; readers step over it.
+    uint64_t stall_pos;
+    uint64_t stall_since;
+
+    bool map_current(int new_fd);
+    void unmap();
+    bool lock_current(int& new_fd);
+    bool follow();
+    bool try_append(std::string_view text);
+    bool compact(uint64_t new_capacity);
+
+public:
+    SharedLog();
+    ~SharedLog();
+    SharedLog(const SharedLog&) = delete;
+    SharedLog& operator=(const SharedLog&) = delete;
+
+    // Maps file, creating a log with room for capacity bytes of records if
+    // there is none; a plain-text history (one command per line) found
+    // there is imported.
+    bool open(const std::string& file, size_t capacity);
+    bool is_open() const { return map != nullptr; }
+    void append(std::string_view text);
+    // Passes each record other sessions committed since the previous call
+    // (everything, on the first call) to fn, oldest first, and returns how
+    // many there were. The views die when fn returns.
+    size_t read_new(const std::function<void(std::string_view)>& fn);
+};
+
+#endif // SHARED_LOG_H
@@ -0,0 +1,32 @@
+#ifndef SHELL_CONTEXT_H
+#define SHELL_CONTEXT_H
+
+#include "buffer_pool.h"
+#include "command_hash.h"
+#include "job_control.h"
+#include <unistd.h>
+
+// State shared by the executor and builtins.
+struct ShellContext {
+    bool running;
+    bool interactive;
+    int last_status;
+    int pipe_size; // F_SETPIPE_SZ for pipeline pipes, 0 for the kernel default
+    // Where commands read and write by default, and where the shell's
+    // own error messages go; an embedder points these at capture pipes.
+    int stdin_fd;
+    int stdout_fd;
+    int stderr_fd;
+    // Nonzero inside $(...): builtins that change shell state then run
+    // in a forked child, as they would in a subshell.
+    int substitution_depth;
+    JobControl job_control;
+    CommandHash command_hash;
+    BufferPool buffers;
+
+    explicit ShellContext(bool interactive)
+        : running(true), interactive(interactive), last_status(0), pipe_size(0), stdin_fd(STDIN_FILENO),
+          stdout_fd(STDOUT_FILENO), stderr_fd(STDERR_FILENO), substitution_depth(0), job_control(interactive) {}
+};
+
+#endif // SHELL_CONTEXT_H
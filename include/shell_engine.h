@@ -0,0 +1,46 @@
+#ifndef SHELL_ENGINE_H
+#define SHELL_ENGINE_H
+
+#include "shell_context.h"
+#include <string>
+#include <string_view>
+
+// Result of ShellEngine::run. out and err view the engine's pooled
+// buffers and stay valid until the next run on the same engine.
+struct CommandResult {
+    int status;
+    std::string_view out;
+    std::string_view err;
+};
+
+// The shell as a library: runs command lines non-interactively with the
+// same parser, builtins, PATH hash and job table as fusionshell, and
+// captures stdout and stderr through pipes straight into memory.
+// Builtin state (cwd, environment, hash) persists between runs; `exit`
+// stops the rest of its line but not later runs.
+//
+// Commands get /dev/null on stdin. An engine is not thread-safe; use
+// one per thread. The host must not set SIGCHLD to SIG_IGN.
+class ShellEngine {
+private:
+    ShellContext ctx;
+    std::string out_pool;
+    std::string err_pool;
+    int null_fd;
+
+public:
+    ShellEngine();
+    ~ShellEngine();
+    ShellEngine(const ShellEngine&) = delete;
+    ShellEngine& operator=(const ShellEngine&) = delete;
+
+    // Captures into the engine's reusable buffers.
+    CommandResult run(std::string_view line);
+    // Appends captured output to caller-owned strings; reuse them (after
+    // clear()) to avoid reallocating. Returns the exit status.
+    int run(std::string_view line, std::string& out, std::string& err);
+
+    ShellContext& context() { return ctx; }
+};
+
+#endif // SHELL_ENGINE_H
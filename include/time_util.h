@@ -0,0 +1,13 @@
+#ifndef TIME_UTIL_H
+#define TIME_UTIL_H
+
+#include <cstdint>
+#include <time.h>
+
+inline uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+#endif // TIME_UTIL_H
@@ -0,0 +1,31 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Opt-in execution tracing into a fixed in-memory ring (the oldest
+// events are overwritten), exported as Chrome trace-event JSON for
+// chrome://tracing or ui.perfetto.dev. Event names must be string
+// literals; details are truncated to a short inline buffer.
+//
+// lane picks the timeline track: 0 is the shell itself, anything else
+// is the child pid the event belongs to.
+
+extern bool trace_active;
+
+inline bool tracing() {
+    return trace_active;
+}
+
+void trace_set_enabled(bool enabled);
+void trace_clear();
+size_t trace_size();
+
+void trace_span(const char* name, uint64_t start_ns, uint64_t end_ns, int lane, std::string_view detail = {});
+void trace_instant(const char* name, int lane, std::string_view detail = {});
+
+void trace_write_json(std::string& out);
+
+#endif // TRACE_H
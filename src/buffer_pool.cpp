@@ -0,0 +1,21 @@
+#include "buffer_pool.h"
+
+static const size_t max_spare = 16;
+static const size_t max_retained_bytes = 1 << 20;
+
+std::string BufferPool::acquire() {
+    if (spare.empty()) {
+        return std::string();
+    }
+    std::string buffer = std::move(spare.back());
+    spare.pop_back();
+    buffer.clear();
+    return buffer;
+}
+
+void BufferPool::release(std::string&& buffer) {
+    // Oversized buffers go back to the allocator rather than pinning memory.
+    if (spare.size() < max_spare && buffer.capacity() <= max_retained_bytes) {
+        spare.push_back(std::move(buffer));
+    }
+}
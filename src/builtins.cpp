@@ -0,0 +1,537 @@
+#include "builtins.h"
+#include "io_util.h"
+#include "parallel.h"
+#include "relay.h"
+#include "trace.h"
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern char** environ;
+
+static bool parse_int(std::string_view text, long& value) {
+    if (text.empty()) {
+        return false;
+    }
+    std::string copy(text);
+    char* end;
+    errno = 0;
+    value = strtol(copy.c_str(), &end, 10);
+    return errno == 0 && *end == '\0';
+}
+
+static Job* job_argument(ShellContext& ctx, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    if (args.size() < 2) {
+        Job* job = ctx.job_control.find_current_job();
+        if (!job) {
+            io.err += std::string(args[0]) + ": no current job\n";
+        }
+        return job;
+    }
+    std::string_view spec = args[1];
+    if (!spec.empty() && spec[0] == '%') {
+        spec.remove_prefix(1);
+    }
+    long job_id;
+    if (!parse_int(spec, job_id)) {
+        io.err += "Invalid job ID\n";
+        return nullptr;
+    }
+    Job* job = ctx.job_control.find_job_by_id(static_cast<int>(job_id));
+    if (!job) {
+        io.err += "No such job: " + std::to_string(job_id) + "\n";
+    }
+    return job;
+}
+
+static int builtin_exit(ShellContext& ctx, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    ctx.running = false;
+    if (args.size() < 2) {
+        return ctx.last_status;
+    }
+    long status;
+    if (!parse_int(args[1], status)) {
+        io.err += "exit: " + std::string(args[1]) + ": numeric argument required\n";
+        return 2;
+    }
+    return static_cast<int>(status & 0xff);
+}
+
+static int builtin_jobs(ShellContext& ctx, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    bool verbose = false;
+    for (size_t i = 1; i < args.size(); ++i) {
+        if (args[i] != "-l") {
+            io.err += "jobs: " + std::string(args[i]) + ": invalid option\n";
+            return 2;
+        }
+        verbose = true;
+    }
+    ctx.job_control.print_jobs(io.out, verbose);
+    return 0;
+}
+
+static int builtin_fg(ShellContext& ctx, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    Job* job = job_argument(ctx, args, io);
+    if (!job) {
+        return 1;
+    }
+    // Out before the wait, which lasts as long as the job does.
+    io.out += job->command + "\n";
+    write_all(io.out_fd, io.out);
+    io.out.clear();
+    int status = ctx.job_control.wait_for_job(*job, true);
+    ctx.job_control.restore_terminal_control();
+    return status;
+}
+
+static int builtin_bg(ShellContext& ctx, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    Job* job = job_argument(ctx, args, io);
+    if (!job) {
+        return 1;
+    }
+    ctx.job_control.continue_in_background(*job);
+    io.out += "[" + std::to_string(job->job_id) + "] " + job->command + "\n";
+    return 0;
+}
+
+static int builtin_hash(ShellContext& ctx, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    CommandHash& command_hash = ctx.command_hash;
+    int status = 0;
+    if (args.size() == 1) {
+        command_hash.print(io.out);
+    } else if (args[1] == "-r") {
+        command_hash.clear();
+    } else if (args[1] == "-d") {
+        for (size_t i = 2; i < args.size(); ++i) {
+            if (!command_hash.forget(std::string(args[i]))) {
+                io.err += "hash: " + std::string(args[i]) + ": not found\n";
+                status = 1;
+            }
+        }
+    } else if (args[1] == "-p") {
+        if (args.size() < 4) {
+            io.err += "hash: usage: hash -p path name\n";
+            return 2;
+        }
+        command_hash.set(std::string(args[3]), std::string(args[2]));
+    } else {
+        for (size_t i = 1; i < args.size(); ++i) {
+            if (!command_hash.add(std::string(args[i]))) {
+                io.err += "hash: " + std::string(args[i]) + ": not found\n";
+                status = 1;
+            }
+        }
+    }
+    return status;
+}
+
+// pipesize [bytes[k|m] | default]: buffer size for the pipes of later
+// pipelines. Checked against a scratch pipe so limits surface here.
+static int builtin_pipesize(ShellContext& ctx, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    if (args.size() < 2) {
+        io.out += ctx.pipe_size == 0 ? std::string("default") : std::to_string(ctx.pipe_size);
+        io.out += '\n';
+        return 0;
+    }
+    if (args[1] == "default") {
+        ctx.pipe_size = 0;
+        return 0;
+    }
+    std::string_view text = args[1];
+    long multiplier = 1;
+    if (!text.empty() && (text.back() == 'k' || text.back() == 'K')) {
+        multiplier = 1024;
+        text.remove_suffix(1);
+    } else if (!text.empty() && (text.back() == 'm' || text.back() == 'M')) {
+        multiplier = 1024 * 1024;
+        text.remove_suffix(1);
+    }
+    long size;
+    if (!parse_int(text, size) || size < 0 || size > INT_MAX / multiplier) {
+        io.err += "pipesize: " + std::string(args[1]) + ": invalid size\n";
+        return 2;
+    }
+    size *= multiplier;
+    if (size > 0) {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) == -1) {
+            io.err += std::string("pipesize: ") + strerror(errno) + "\n";
+            return 1;
+        }
+        bool ok = set_pipe_size(fds[1], static_cast<int>(size));
+        int saved = errno;
+        close(fds[0]);
+        close(fds[1]);
+        if (!ok) {
+            io.err += "pipesize: " + std::to_string(size) + ": " + strerror(saved) + "\n";
+            return 1;
+        }
+    }
+    ctx.pipe_size = static_cast<int>(size);
+    return 0;
+}
+
+// tee [-a] file...: copies stdin to stdout and each file, through
+// tee(2)/splice(2) when stdin is a pipe.
+static int builtin_tee(ShellContext&, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    size_t first = 1;
+    if (args.size() > 1 && args[1] == "-a") {
+        flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+        first = 2;
+    }
+    int status = 0;
+    std::vector<int> outs;
+    for (size_t i = first; i < args.size(); ++i) {
+        int fd = open(std::string(args[i]).c_str(), flags, 0644);
+        if (fd == -1) {
+            io.err += "tee: " + std::string(args[i]) + ": " + strerror(errno) + "\n";
+            status = 1;
+            continue;
+        }
+        outs.push_back(fd);
+    }
+    // stdout goes last: it receives the source pipe's pages by splice.
+    outs.push_back(io.out_fd);
+    if (!relay_fanout(io.in_fd, outs)) {
+        io.err += std::string("tee: ") + strerror(errno) + "\n";
+        status = 1;
+    }
+    for (size_t i = 0; i + 1 < outs.size(); ++i) {
+        close(outs[i]);
+    }
+    return status;
+}
+
+// trace [on|off|clear|dump [file]]: controls the execution trace ring;
+// dump writes Chrome trace-event JSON to stdout or file.
+static int builtin_trace(ShellContext&, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    if (args.size() < 2) {
+        io.out += std::string(tracing() ? "on" : "off") + ", " + std::to_string(trace_size()) + " events\n";
+        return 0;
+    }
+    if (args[1] == "on" || args[1] == "off") {
+        trace_set_enabled(args[1] == "on");
+        return 0;
+    }
+    if (args[1] == "clear") {
+        trace_clear();
+        return 0;
+    }
+    if (args[1] == "dump") {
+        if (args.size() < 3) {
+            trace_write_json(io.out);
+            return 0;
+        }
+        std::string json;
+        trace_write_json(json);
+        std::string file(args[2]);
+        int fd = open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd == -1 || !write_all(fd, json)) {
+            io.err += "trace: " + file + ": " + strerror(errno) + "\n";
+            if (fd != -1) {
+                close(fd);
+            }
+            return 1;
+        }
+        close(fd);
+        return 0;
+    }
+    io.err += "trace: usage: trace [on|off|clear|dump [file]]\n";
+    return 2;
+}
+
+static int builtin_cd(ShellContext&, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    std::string target;
+    bool print_target = false;
+    if (args.size() < 2) {
+        const char* home = getenv("HOME");
+        if (!home) {
+            io.err += "cd: HOME not set\n";
+            return 1;
+        }
+        target = home;
+    } else if (args[1] == "-") {
+        const char* old = getenv("OLDPWD");
+        if (!old) {
+            io.err += "cd: OLDPWD not set\n";
+            return 1;
+        }
+        target = old;
+        print_target = true;
+    } else {
+        target = std::string(args[1]);
+    }
+
+    char previous[PATH_MAX];
+    bool have_previous = getcwd(previous, sizeof(previous)) != nullptr;
+    if (chdir(target.c_str()) == -1) {
+        io.err += "cd: " + target + ": " + strerror(errno) + "\n";
+        return 1;
+    }
+    if (have_previous) {
+        setenv("OLDPWD", previous, 1);
+    }
+    char current[PATH_MAX];
+    if (getcwd(current, sizeof(current))) {
+        setenv("PWD", current, 1);
+        if (print_target) {
+            io.out += std::string(current) + "\n";
+        }
+    }
+    return 0;
+}
+
+static int builtin_pwd(ShellContext&, const std::vector<std::string_view>&, BuiltinIO& io) {
+    char current[PATH_MAX];
+    if (!getcwd(current, sizeof(current))) {
+        io.err += std::string("pwd: ") + strerror(errno) + "\n";
+        return 1;
+    }
+    io.out += current;
+    io.out += '\n';
+    return 0;
+}
+
+static int builtin_echo(ShellContext&, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    size_t first = 1;
+    bool newline = true;
+    if (args.size() > 1 && args[1] == "-n") {
+        newline = false;
+        first = 2;
+    }
+    for (size_t i = first; i < args.size(); ++i) {
+        if (i > first) {
+            io.out += ' ';
+        }
+        io.out += args[i];
+    }
+    if (newline) {
+        io.out += '\n';
+    }
+    return 0;
+}
+
+static int builtin_export(ShellContext&, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    if (args.size() == 1) {
+        for (char** env = environ; *env; ++env) {
+            io.out += "export ";
+            io.out += *env;
+            io.out += '\n';
+        }
+        return 0;
+    }
+    int status = 0;
+    for (size_t i = 1; i < args.size(); ++i) {
+        std::string_view arg = args[i];
+        size_t eq = arg.find('=');
+        std::string name(arg.substr(0, eq));
+        if (name.empty()) {
+            io.err += "export: `" + std::string(arg) + "': not a valid identifier\n";
+            status = 1;
+            continue;
+        }
+        if (eq != std::string_view::npos) {
+            setenv(name.c_str(), std::string(arg.substr(eq + 1)).c_str(), 1);
+        } else if (!getenv(name.c_str())) {
+            setenv(name.c_str(), "", 1);
+        }
+    }
+    return status;
+}
+
+static int builtin_unset(ShellContext&, const std::vector<std::string_view>& args, BuiltinIO&) {
+    for (size_t i = 1; i < args.size(); ++i) {
+        unsetenv(std::string(args[i]).c_str());
+    }
+    return 0;
+}
+
+static int builtin_true(ShellContext&, const std::vector<std::string_view>&, BuiltinIO&) {
+    return 0;
+}
+
+static int builtin_false(ShellContext&, const std::vector<std::string_view>&, BuiltinIO&) {
+    return 1;
+}
+
+// Evaluates test's operands; returns 0 (true), 1 (false) or 2 (error).
+static int evaluate_test(const std::string_view* argv, size_t argc, BuiltinIO& io) {
+    if (argc == 0) {
+        return 1;
+    }
+    if (argv[0] == "!" && argc > 1) {
+        int inner = evaluate_test(argv + 1, argc - 1, io);
+        return inner == 2 ? 2 : !inner;
+    }
+    if (argc == 1) {
+        return argv[0].empty() ? 1 : 0;
+    }
+    if (argc == 2) {
+        std::string_view op = argv[0];
+        std::string operand(argv[1]);
+        if (op == "-n") {
+            return operand.empty() ? 1 : 0;
+        }
+        if (op == "-z") {
+            return operand.empty() ? 0 : 1;
+        }
+        struct stat st;
+        bool exists = stat(operand.c_str(), &st) == 0;
+        if (op == "-e") {
+            return exists ? 0 : 1;
+        }
+        if (op == "-f") {
+            return exists && S_ISREG(st.st_mode) ? 0 : 1;
+        }
+        if (op == "-d") {
+            return exists && S_ISDIR(st.st_mode) ? 0 : 1;
+        }
+        if (op == "-s") {
+            return exists && st.st_size > 0 ? 0 : 1;
+        }
+        if (op == "-r") {
+            return access(operand.c_str(), R_OK) == 0 ? 0 : 1;
+        }
+        if (op == "-w") {
+            return access(operand.c_str(), W_OK) == 0 ? 0 : 1;
+        }
+        if (op == "-x") {
+            return access(operand.c_str(), X_OK) == 0 ? 0 : 1;
+        }
+        io.err += "test: " + std::string(op) + ": unary operator expected\n";
+        return 2;
+    }
+    if (argc == 3) {
+        std::string_view lhs = argv[0];
+        std::string_view op = argv[1];
+        std::string_view rhs = argv[2];
+        if (op == "=" || op == "==") {
+            return lhs == rhs ? 0 : 1;
+        }
+        if (op == "!=") {
+            return lhs != rhs ? 0 : 1;
+        }
+        long a;
+        long b;
+        if (op == "-eq" || op == "-ne" || op == "-lt" || op == "-le" || op == "-gt" || op == "-ge") {
+            if (!parse_int(lhs, a) || !parse_int(rhs, b)) {
+                io.err += "test: integer expression expected\n";
+                return 2;
+            }
+            bool result = op == "-eq" ? a == b : op == "-ne" ? a != b : op == "-lt" ? a < b
+                        : op == "-le" ? a <= b : op == "-gt" ? a > b : a >= b;
+            return result ? 0 : 1;
+        }
+        io.err += "test: " + std::string(op) + ": binary operator expected\n";
+        return 2;
+    }
+    io.err += "test: too many arguments\n";
+    return 2;
+}
+
+static int builtin_test(ShellContext&, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    size_t argc = args.size() - 1;
+    if (args[0] == "[") {
+        if (argc == 0 || args.back() != "]") {
+            io.err += "[: missing `]'\n";
+            return 2;
+        }
+        argc--;
+    }
+    return evaluate_test(args.data() + 1, argc, io);
+}
+
+static constexpr Builtin builtins[] = {
+    {"exit", builtin_exit},
+    {"jobs", builtin_jobs, false, true},
+    {"fg", builtin_fg},
+    {"bg", builtin_bg},
+    {"hash", builtin_hash},
+    {"cd", builtin_cd},
+    {"pwd", builtin_pwd, false, true},
+    {"echo", builtin_echo, false, true},
+    {"export", builtin_export},
+    {"unset", builtin_unset},
+    {"true", builtin_true, false, true},
+    {"false", builtin_false, false, true},
+    {":", builtin_true, false, true},
+    {"test", builtin_test, false, true},
+    {"[", builtin_test, false, true},
+    {"pipesize", builtin_pipesize},
+    {"tee", builtin_tee, true},
+    {"parallel", builtin_parallel, true},
+    {"trace", builtin_trace},
+};
+
+static constexpr size_t builtin_count = sizeof(builtins) / sizeof(builtins[0]);
+static constexpr size_t table_size = 64;
+
+static constexpr uint32_t name_hash(std::string_view name, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (char c : name) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static constexpr bool seed_is_perfect(uint32_t seed) {
+    bool used[table_size] = {};
+    for (size_t i = 0; i < builtin_count; ++i) {
+        size_t slot = name_hash(builtins[i].name, seed) % table_size;
+        if (used[slot]) {
+            return false;
+        }
+        used[slot] = true;
+    }
+    return true;
+}
+
+static constexpr uint32_t find_seed() {
+    for (uint32_t seed = 0; seed < 100000; ++seed) {
+        if (seed_is_perfect(seed)) {
+            return seed;
+        }
+    }
+    return UINT32_MAX;
+}
+
+static constexpr uint32_t hash_seed = find_seed();
+static_assert(hash_seed != UINT32_MAX, "no collision-free seed for the builtin table");
+
+struct SlotTable {
+    int8_t slots[table_size];
+};
+
+static constexpr SlotTable build_slots() {
+    SlotTable table{};
+    for (size_t i = 0; i < table_size; ++i) {
+        table.slots[i] = -1;
+    }
+    for (size_t i = 0; i < builtin_count; ++i) {
+        table.slots[name_hash(builtins[i].name, hash_seed) % table_size] = static_cast<int8_t>(i);
+    }
+    return table;
+}
+
+static constexpr SlotTable slot_table = build_slots();
+
+const Builtin* find_builtin(std::string_view name) {
+    int8_t index = slot_table.slots[name_hash(name, hash_seed) % table_size];
+    if (index < 0 || builtins[index].name != name) {
+        return nullptr;
+    }
+    return &builtins[index];
+}
+
+void list_builtins(std::vector<std::string_view>& names) {
+    for (const auto& builtin : builtins) {
+        names.push_back(builtin.name);
+    }
+}
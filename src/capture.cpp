@@ -0,0 +1,113 @@
+#include "capture.h"
+#include "executor.h"
+#include "io_util.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <thread>
+#include <unistd.h>
+
+// Reads the pipes until they hit EOF, or until done_fd fires; then
+// takes whatever is already buffered and stops, so a background job
+// still holding a pipe open cannot stall the caller.
+static void collect_output(int out_fd, int err_fd, int done_fd, std::string* out, std::string* err) {
+    struct pollfd fds[3] = {{out_fd, POLLIN, 0}, {err_fd, POLLIN, 0}, {done_fd, POLLIN, 0}};
+    std::string* sinks[2] = {out, err};
+    bool open[2] = {out_fd != -1, err_fd != -1};
+    bool finishing = false;
+    char buffer[65536];
+    while (open[0] || open[1]) {
+        if (!finishing && poll(fds, 3, -1) == -1) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        if (fds[2].revents & POLLIN) {
+            finishing = true;
+        }
+        for (int i = 0; i < 2; ++i) {
+            if (!open[i] || (!finishing && fds[i].revents == 0)) {
+                continue;
+            }
+            while (true) {
+                ssize_t n = read(fds[i].fd, buffer, sizeof(buffer));
+                if (n > 0) {
+                    sinks[i]->append(buffer, n);
+                    continue;
+                }
+                if (n == -1 && errno == EINTR) {
+                    continue;
+                }
+                if (n == 0) {
+                    open[i] = false;
+                    fds[i].fd = -1;
+                }
+                break;
+            }
+        }
+        if (finishing) {
+            return;
+        }
+    }
+}
+
+static bool open_pipe(int fds[2], ShellContext& ctx, std::string* err) {
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        std::string message = std::string("pipe: ") + strerror(errno) + "\n";
+        if (err) {
+            *err += message;
+        } else {
+            write_all(ctx.stderr_fd, message);
+        }
+        return false;
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    return true;
+}
+
+int execute_captured(const ParsedCommand& parsed, ShellContext& ctx, std::string& out, std::string* err) {
+    int out_pipe[2] = {-1, -1};
+    int err_pipe[2] = {-1, -1};
+    if (!open_pipe(out_pipe, ctx, err)) {
+        return 1;
+    }
+    if (err && !open_pipe(err_pipe, ctx, err)) {
+        close(out_pipe[0]);
+        close(out_pipe[1]);
+        return 1;
+    }
+    int done_fd = eventfd(0, EFD_CLOEXEC);
+    std::thread collector(collect_output, out_pipe[0], err_pipe[0], done_fd, &out, err);
+
+    int saved_out = ctx.stdout_fd;
+    int saved_err = ctx.stderr_fd;
+    ctx.stdout_fd = out_pipe[1];
+    if (err) {
+        ctx.stderr_fd = err_pipe[1];
+    }
+    int status = 0;
+    if (parsed.error) {
+        write_all(ctx.stderr_fd, parsed.error);
+        write_all(ctx.stderr_fd, "\n");
+        status = 2;
+    } else if (!parsed.empty()) {
+        status = execute_command(parsed, ctx);
+    }
+    ctx.stdout_fd = saved_out;
+    ctx.stderr_fd = saved_err;
+
+    for (int fd : {out_pipe[1], err_pipe[1]}) {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+    eventfd_write(done_fd, 1);
+    collector.join();
+    for (int fd : {out_pipe[0], err_pipe[0], done_fd}) {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+    return status;
+}
@@ -0,0 +1,92 @@
+#include "command_hash.h"
+#include <cstdlib>
+#include <sys/stat.h>
+#include <unistd.h>
+
+void CommandHash::check_path() {
+    const char* path = getenv("PATH");
+    const char* current = path ? path : "";
+    if (path_snapshot != current) {
+        entries.clear();
+        path_snapshot = current;
+    }
+}
+
+std::string CommandHash::search_path(const std::string& name, const std::string& path) {
+    size_t start = 0;
+    std::string candidate;
+    while (start <= path.size()) {
+        size_t end = path.find(':', start);
+        if (end == std::string::npos) {
+            end = path.size();
+        }
+        candidate.assign(path, start, end - start);
+        if (candidate.empty()) {
+            candidate = ".";
+        }
+        candidate += '/';
+        candidate += name;
+
+        struct stat st;
+        if (stat(candidate.c_str(), &st) == 0 && S_ISREG(st.st_mode) && access(candidate.c_str(), X_OK) == 0) {
+            return candidate;
+        }
+        start = end + 1;
+    }
+    return "";
+}
+
+std::string CommandHash::lookup(const std::string& name) {
+    if (name.find('/') != std::string::npos) {
+        return name;
+    }
+    check_path();
+    auto it = entries.find(name);
+    if (it != entries.end()) {
+        it->second.hits++;
+        return it->second.path;
+    }
+    std::string path = search_path(name, path_snapshot);
+    if (!path.empty()) {
+        entries[name] = HashEntry{path, 1};
+    }
+    return path;
+}
+
+bool CommandHash::add(const std::string& name) {
+    if (name.find('/') != std::string::npos) {
+        return true;
+    }
+    check_path();
+    std::string path = search_path(name, path_snapshot);
+    if (path.empty()) {
+        entries.erase(name);
+        return false;
+    }
+    entries[name] = HashEntry{path, 0};
+    return true;
+}
+
+void CommandHash::set(const std::string& name, const std::string& path) {
+    check_path();
+    entries[name] = HashEntry{path, 0};
+}
+
+bool CommandHash::forget(const std::string& name) {
+    return entries.erase(name) > 0;
+}
+
+void CommandHash::clear() {
+    entries.clear();
+}
+
+void CommandHash::print(std::string& out) const {
+    if (entries.empty()) {
+        out += "hash: hash table empty\n";
+        return;
+    }
+    out += "hits\tcommand\n";
+    for (const auto& pair : entries) {
+        out += "   " + std::to_string(pair.second.hits) + "\t" + pair.second.path + "\n";
+    }
+}
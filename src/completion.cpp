@@ -0,0 +1,398 @@
+#include "completion.h"
+#include "builtins.h"
+#include "log.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const size_t max_listings = 32;
+static const uint32_t watch_mask =
+    IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+// The same test CommandHash applies when it searches PATH.
+static bool executable_at(int dir_fd, const char* name) {
+    struct stat st;
+    return fstatat(dir_fd, name, &st, 0) == 0 && S_ISREG(st.st_mode) && faccessat(dir_fd, name, X_OK, 0) == 0;
+}
+
+static bool directory_entry(int dir_fd, const struct dirent* entry) {
+    if (entry->d_type == DT_DIR) {
+        return true;
+    }
+    if (entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN) {
+        return false;
+    }
+    struct stat st;
+    return fstatat(dir_fd, entry->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+}
+
+Completer::Completer()
+    : inotify_fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)), indexed(false), use_clock(0), unwatched_id(-2) {
+    if (inotify_fd == -1) {
+        LOG_WARNF("inotify unavailable (%s); completion rescans on every Tab", strerror(errno));
+    }
+}
+
+Completer::~Completer() {
+    wait_for_index();
+    if (inotify_fd != -1) {
+        close(inotify_fd);
+    }
+}
+
+void Completer::warm_up() {
+    if (indexer.joinable() || indexed) {
+        return;
+    }
+    const char* path = getenv("PATH");
+    path_snapshot = path ? path : "";
+    indexer = std::thread(&Completer::build_path_index, this);
+}
+
+void Completer::wait_for_index() {
+    if (indexer.joinable()) {
+        indexer.join();
+    }
+}
+
+int Completer::watch(const std::string& path) {
+    int wd = inotify_fd == -1 ? unwatched_id-- : inotify_add_watch(inotify_fd, path.c_str(), watch_mask);
+    if (wd == -1) {
+        return -1;
+    }
+    // A directory reached through two paths (/bin and /usr/bin) gets the
+    // same descriptor, and so the same entry.
+    WatchedDir& dir = watches[wd];
+    if (dir.path.empty()) {
+        dir.path = path;
+    }
+    return wd;
+}
+
+void Completer::unwatch(int wd) {
+    if (inotify_fd != -1) {
+        inotify_rm_watch(inotify_fd, wd);
+    }
+    watches.erase(wd);
+}
+
+void Completer::add_command(const std::string& name) {
+    auto it = std::lower_bound(commands.begin(), commands.end(), name,
+                               [](const Name& entry, const std::string& key) { return entry.name < key; });
+    if (it != commands.end() && it->name == name) {
+        it->sources++;
+    } else {
+        commands.insert(it, Name{name, false, 1});
+    }
+}
+
+void Completer::remove_command(const std::string& name) {
+    auto it = std::lower_bound(commands.begin(), commands.end(), name,
+                               [](const Name& entry, const std::string& key) { return entry.name < key; });
+    if (it != commands.end() && it->name == name && --it->sources == 0) {
+        commands.erase(it);
+    }
+}
+
+void Completer::refresh_command(WatchedDir& dir, const std::string& name) {
+    bool executable = executable_at(AT_FDCWD, (dir.path + "/" + name).c_str());
+    bool known = dir.commands.count(name) > 0;
+    if (executable && !known) {
+        dir.commands.insert(name);
+        add_command(name);
+    } else if (!executable && known) {
+        dir.commands.erase(name);
+        remove_command(name);
+    }
+}
+
+void Completer::drop_path_dir(WatchedDir& dir) {
+    for (const auto& name : dir.commands) {
+        remove_command(name);
+    }
+    dir.commands.clear();
+    dir.on_path = false;
+}
+
+void Completer::drop_listing(WatchedDir& dir) {
+    if (dir.listed) {
+        listings.erase(dir.path);
+    }
+    dir.listed = false;
+    dir.visible.clear();
+    dir.hidden.clear();
+}
+
+void Completer::reset() {
+    for (const auto& pair : watches) {
+        if (inotify_fd != -1) {
+            inotify_rm_watch(inotify_fd, pair.first);
+        }
+    }
+    watches.clear();
+    listings.clear();
+    commands.clear();
+    indexed = false;
+}
+
+void Completer::check_path() {
+    const char* path = getenv("PATH");
+    const char* current = path ? path : "";
+    if (!indexed || path_snapshot != current) {
+        path_snapshot = current;
+        build_path_index();
+    }
+}
+
+// Relative PATH entries (including the empty one) are skipped: what they
+// name changes with every cd. A directory that is missing now is not
+// noticed if it appears later; the next PATH change picks it up.
+void Completer::build_path_index() {
+    for (auto it = watches.begin(); it != watches.end();) {
+        WatchedDir& dir = it->second;
+        dir.on_path = false;
+        dir.commands.clear();
+        if (!dir.listed) {
+            if (inotify_fd != -1) {
+                inotify_rm_watch(inotify_fd, it->first);
+            }
+            it = watches.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    std::vector<std::string_view> builtin_names;
+    list_builtins(builtin_names);
+    std::vector<std::string> names(builtin_names.begin(), builtin_names.end());
+    size_t start = 0;
+    while (start <= path_snapshot.size()) {
+        size_t end = path_snapshot.find(':', start);
+        if (end == std::string::npos) {
+            end = path_snapshot.size();
+        }
+        std::string path = path_snapshot.substr(start, end - start);
+        start = end + 1;
+        if (path.empty() || path[0] != '/') {
+            continue;
+        }
+        // Watch before reading, so nothing created in between is missed.
+        int wd = watch(path);
+        if (wd == -1) {
+            continue;
+        }
+        WatchedDir& dir = watches[wd];
+        if (dir.on_path) {
+            continue;
+        }
+        dir.on_path = true;
+        DIR* dp = opendir(path.c_str());
+        if (!dp) {
+            continue;
+        }
+        int dir_fd = dirfd(dp);
+        while (struct dirent* entry = readdir(dp)) {
+            if (entry->d_name[0] == '.' || entry->d_type == DT_DIR) {
+                continue;
+            }
+            if (executable_at(dir_fd, entry->d_name)) {
+                dir.commands.insert(entry->d_name);
+                names.push_back(entry->d_name);
+            }
+        }
+        closedir(dp);
+    }
+
+    std::sort(names.begin(), names.end());
+    commands.clear();
+    for (const auto& name : names) {
+        if (!commands.empty() && commands.back().name == name) {
+            commands.back().sources++;
+        } else {
+            commands.push_back(Name{name, false, 1});
+        }
+    }
+    indexed = true;
+}
+
+Completer::WatchedDir* Completer::listing(const std::string& path) {
+    auto found = listings.find(path);
+    if (found != listings.end()) {
+        WatchedDir& dir = watches[found->second];
+        dir.last_used = ++use_clock;
+        return &dir;
+    }
+    if (listings.size() >= max_listings) {
+        auto oldest = listings.begin();
+        for (auto it = listings.begin(); it != listings.end(); ++it) {
+            if (watches[it->second].last_used < watches[oldest->second].last_used) {
+                oldest = it;
+            }
+        }
+        int wd = oldest->second;
+        WatchedDir& dir = watches[wd];
+        drop_listing(dir);
+        if (!dir.on_path) {
+            unwatch(wd);
+        }
+    }
+
+    int wd = watch(path);
+    if (wd == -1) {
+        return nullptr;
+    }
+    WatchedDir& dir = watches[wd];
+    dir.last_used = ++use_clock;
+    if (dir.listed) {
+        return &dir; // the same directory, cached under another path
+    }
+    DIR* dp = opendir(path.c_str());
+    if (!dp) {
+        if (!dir.on_path) {
+            unwatch(wd);
+        }
+        return nullptr;
+    }
+    int dir_fd = dirfd(dp);
+    while (struct dirent* entry = readdir(dp)) {
+        const char* name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+        Name item{name, directory_entry(dir_fd, entry), 0};
+        (name[0] == '.' ? dir.hidden : dir.visible).push_back(std::move(item));
+    }
+    closedir(dp);
+    auto order = [](const Name& a, const Name& b) { return a.name < b.name; };
+    std::sort(dir.visible.begin(), dir.visible.end(), order);
+    std::sort(dir.hidden.begin(), dir.hidden.end(), order);
+    dir.listed = true;
+    dir.path = path;
+    listings[path] = wd;
+    return &dir;
+}
+
+void Completer::handle_events() {
+    wait_for_index();
+    if (inotify_fd == -1) {
+        return;
+    }
+    alignas(struct inotify_event) char buffer[16384];
+    while (true) {
+        ssize_t n = read(inotify_fd, buffer, sizeof(buffer));
+        if (n <= 0) {
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        for (char* p = buffer; p < buffer + n;) {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+            p += sizeof(struct inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                LOG_DEBUGF("inotify queue overflowed; rebuilding the completion index");
+                reset();
+                continue;
+            }
+            auto it = watches.find(event->wd);
+            if (it == watches.end()) {
+                continue;
+            }
+            WatchedDir& dir = it->second;
+            if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                drop_path_dir(dir);
+                drop_listing(dir);
+                unwatch(event->wd);
+                continue;
+            }
+            if (dir.on_path && event->len > 0) {
+                refresh_command(dir, event->name);
+            }
+            if (dir.listed) {
+                drop_listing(dir);
+                if (!dir.on_path) {
+                    unwatch(event->wd);
+                }
+            }
+        }
+    }
+}
+
+void Completer::collect(const std::vector<Name>& names, std::string_view prefix, std::string_view dir_part,
+                        CompletionResult& result) {
+    auto first = std::lower_bound(names.begin(), names.end(), prefix,
+                                  [](const Name& entry, std::string_view key) { return entry.name < key; });
+    auto last = std::partition_point(first, names.end(), [&](const Name& entry) {
+        return entry.name.compare(0, prefix.size(), prefix) == 0;
+    });
+    result.count = last - first;
+    if (result.count == 0) {
+        return;
+    }
+    // The names are sorted, so what the first and last share, all share.
+    const std::string& low = first->name;
+    const std::string& high = (last - 1)->name;
+    size_t common = std::mismatch(low.begin(), low.end(), high.begin(), high.end()).first - low.begin();
+    result.common.assign(dir_part.data(), dir_part.size());
+    result.common.append(low, 0, common);
+    result.directory = result.count == 1 && first->directory;
+    if (result.directory) {
+        result.common += '/';
+    }
+    for (auto it = first; it != last && result.shown.size() < max_shown; ++it) {
+        result.shown.push_back(it->directory ? it->name + "/" : it->name);
+    }
+}
+
+void Completer::complete_command(std::string_view prefix, CompletionResult& result) {
+    wait_for_index();
+    if (inotify_fd == -1) {
+        reset();
+    }
+    handle_events();
+    check_path();
+    collect(commands, prefix, "", result);
+}
+
+void Completer::complete_file(std::string_view word, CompletionResult& result) {
+    size_t slash = word.rfind('/');
+    std::string_view dir_part = slash == std::string_view::npos ? std::string_view() : word.substr(0, slash + 1);
+    std::string_view prefix = word.substr(dir_part.size());
+
+    std::string path;
+    if (dir_part.substr(0, 2) == "~/") {
+        const char* home = getenv("HOME");
+        path = home ? home : "";
+        path += dir_part.substr(1);
+    } else if (!dir_part.empty() && dir_part[0] == '/') {
+        path = dir_part;
+    } else {
+        char cwd[4096];
+        if (!getcwd(cwd, sizeof(cwd))) {
+            return;
+        }
+        path = cwd;
+        path += '/';
+        path += dir_part;
+    }
+    while (path.size() > 1 && path.back() == '/') {
+        path.pop_back();
+    }
+
+    wait_for_index();
+    if (inotify_fd == -1) {
+        reset();
+    }
+    handle_events();
+    WatchedDir* dir = listing(path);
+    if (!dir) {
+        return;
+    }
+    collect(!prefix.empty() && prefix[0] == '.' ? dir->hidden : dir->visible, prefix, dir_part, result);
+}
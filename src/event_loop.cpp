@@ -0,0 +1,121 @@
+#include "event_loop.h"
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <cerrno>
+
+EventLoop::EventLoop() : epoll_fd(epoll_create1(EPOLL_CLOEXEC)), signal_fd(-1) {
+    sigemptyset(&signal_mask);
+}
+
+EventLoop::~EventLoop() {
+    for (int timer : timers) {
+        close(timer);
+    }
+    if (signal_fd != -1) {
+        close(signal_fd);
+    }
+    if (epoll_fd != -1) {
+        close(epoll_fd);
+    }
+}
+
+bool EventLoop::add_fd(int fd, uint32_t events, FdCallback callback) {
+    struct epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+    int op = fd_callbacks.count(fd) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(epoll_fd, op, fd, &ev) == -1) {
+        return false;
+    }
+    fd_callbacks[fd] = std::move(callback);
+    return true;
+}
+
+void EventLoop::remove_fd(int fd) {
+    if (fd_callbacks.erase(fd) > 0) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+}
+
+int EventLoop::add_timer(std::function<void()> callback) {
+    int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer == -1) {
+        return -1;
+    }
+    bool added = add_fd(timer, EPOLLIN, [timer, callback](uint32_t) {
+        uint64_t expirations;
+        if (read(timer, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+            callback();
+        }
+    });
+    if (!added) {
+        close(timer);
+        return -1;
+    }
+    timers.insert(timer);
+    return timer;
+}
+
+void EventLoop::arm_timer(int timer, uint64_t delay_ms, uint64_t interval_ms) {
+    struct itimerspec spec{};
+    spec.it_value.tv_sec = delay_ms / 1000;
+    spec.it_value.tv_nsec = (delay_ms % 1000) * 1000000;
+    spec.it_interval.tv_sec = interval_ms / 1000;
+    spec.it_interval.tv_nsec = (interval_ms % 1000) * 1000000;
+    timerfd_settime(timer, 0, &spec, nullptr);
+}
+
+void EventLoop::remove_timer(int timer) {
+    if (timers.erase(timer) == 0) {
+        return;
+    }
+    remove_fd(timer);
+    close(timer);
+}
+
+bool EventLoop::watch_signal(int signo, SignalCallback callback) {
+    sigaddset(&signal_mask, signo);
+    if (sigprocmask(SIG_BLOCK, &signal_mask, nullptr) == -1) {
+        return false;
+    }
+    int fd = signalfd(signal_fd, &signal_mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    if (signal_fd == -1) {
+        signal_fd = fd;
+        if (!add_fd(signal_fd, EPOLLIN, [this](uint32_t) { dispatch_signals(); })) {
+            return false;
+        }
+    }
+    signal_callbacks[signo] = std::move(callback);
+    return true;
+}
+
+void EventLoop::dispatch_signals() {
+    signalfd_siginfo info;
+    while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        auto it = signal_callbacks.find(static_cast<int>(info.ssi_signo));
+        if (it != signal_callbacks.end()) {
+            it->second(info);
+        }
+    }
+}
+
+int EventLoop::run_once(int timeout_ms) {
+    struct epoll_event events[16];
+    int n = epoll_wait(epoll_fd, events, 16, timeout_ms);
+    if (n == -1) {
+        return errno == EINTR ? 0 : -1;
+    }
+    for (int i = 0; i < n; ++i) {
+        auto it = fd_callbacks.find(events[i].data.fd);
+        if (it == fd_callbacks.end()) {
+            continue; // removed by an earlier callback in this batch
+        }
+        FdCallback callback = it->second;
+        callback(events[i].events);
+    }
+    return n;
+}
@@ -1,125 +1,444 @@
 #include "executor.h"
+#include "builtins.h"
+#include "expand.h"
+#include "io_util.h"
+#include "launcher.h"
+#include "log.h"
+#include "relay.h"
+#include "time_util.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstdio>
 #include <iostream>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 #include <cstring>
+#include <cerrno>
+#include <csignal>
 
-void execute_command(const ParsedCommand& cmd, bool& running, JobControl& job_control) {
-    if (cmd.commands.empty()) {
-        return;
-    }
-
-    std::vector<int> pipe_fds;
-    std::vector<pid_t> pids;
+// Shell diagnostics follow ctx.stderr_fd so an embedder captures them.
+static void write_stderr(ShellContext& ctx, const std::string& message) {
+    std::cout.flush();
+    write_all(ctx.stderr_fd, message);
+}
 
-    for (size_t i = 0; i < cmd.commands.size(); ++i) {
-        int pipefd[2] = {-1, -1};
-        if (i < cmd.commands.size() - 1) {
-            if (pipe(pipefd) == -1) {
-                std::cerr << "Pipe failed\n";
-                return;
+// A lone foreground builtin runs inside the shell: no fork, and its
+// buffered output goes straight to the redirection target or stdout.
+static int run_builtin(const Builtin& builtin, const Command& command, ShellContext& ctx) {
+    int in_fd = ctx.stdin_fd;
+    if (!command.input_file.empty()) {
+        in_fd = open(command.input_file.data(), O_RDONLY | O_CLOEXEC);
+        if (in_fd == -1) {
+            write_stderr(ctx, "Failed to open input file: " + std::string(command.input_file) + "\n");
+            return 1;
+        }
+    }
+    int out_fd = ctx.stdout_fd;
+    if (!command.output_file.empty()) {
+        out_fd = open(command.output_file.data(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (out_fd == -1) {
+            write_stderr(ctx, "Failed to open output file: " + std::string(command.output_file) + "\n");
+            if (in_fd != ctx.stdin_fd) {
+                close(in_fd);
             }
-            pipe_fds.push_back(pipefd[0]);
-            pipe_fds.push_back(pipefd[1]);
+            return 1;
         }
+    }
+
+    BuiltinIO io;
+    io.in_fd = in_fd;
+    io.out_fd = out_fd;
+    uint64_t start = tracing() ? monotonic_ns() : 0;
+    int status = builtin.run(ctx, command.tokens, io);
+    if (tracing()) {
+        trace_span("builtin", start, monotonic_ns(), 0, builtin.name);
+    }
+    std::cout.flush();
+    if (!io.out.empty()) {
+        trace_instant("first_output", 0, builtin.name);
+    }
+    write_all(out_fd, io.out);
+    write_all(ctx.stderr_fd, io.err);
+    if (in_fd != ctx.stdin_fd) {
+        close(in_fd);
+    }
+    if (out_fd != ctx.stdout_fd) {
+        close(out_fd);
+    }
+    return status;
+}
 
-        pid_t pid = fork();
+static int run_list(const ParsedCommand& cmd, size_t list, ShellContext& ctx, bool exec_tail);
+
+static const char* stage_name(const Command& command) {
+    return command.subshell != 0 ? "(subshell)" : command.tokens[0].data();
+}
+
+// Runs in the forked child of a ( ... ) stage, whose standard descriptors
+// are already in place. Nothing follows the list in this process, so its
+// last simple command is exec'd rather than forked.
+static int run_subshell(const ParsedCommand& cmd, size_t list, ShellContext& ctx) {
+    ctx.stdin_fd = STDIN_FILENO;
+    ctx.stdout_fd = STDOUT_FILENO;
+    ctx.stderr_fd = STDERR_FILENO;
+    ctx.interactive = false;
+    ctx.substitution_depth = 0;
+    ctx.job_control.enter_subshell();
+    return run_list(cmd, list, ctx, true);
+}
+
+static pid_t launch_stage(const ParsedCommand& cmd, const Command& command, int in_fd, int out_fd, pid_t pgid,
+                          ShellContext& ctx) {
+    uint64_t start = tracing() ? monotonic_ns() : 0;
+    if (command.subshell != 0) {
+        LaunchSpec spec{nullptr, nullptr, in_fd, out_fd, ctx.stderr_fd, pgid,
+                        [&cmd, &command, &ctx]() { return run_subshell(cmd, command.subshell, ctx); }};
+        pid_t pid = launch_process(spec);
+        if (pid == -1) {
+            LOG_ERRORF("fork for subshell failed: %s", strerror(errno));
+            write_stderr(ctx, std::string("Fork failed: ") + strerror(errno) + "\n");
+        } else if (tracing()) {
+            trace_span("fork", start, monotonic_ns(), pid, "(subshell)");
+        }
+        return pid;
+    }
+    if (const Builtin* builtin = find_builtin(command.tokens[0])) {
+        LaunchSpec spec{nullptr, nullptr, in_fd, out_fd, ctx.stderr_fd, pgid, [builtin, &command, &ctx]() {
+            BuiltinIO io;
+            int status = builtin->run(ctx, command.tokens, io);
+            write_all(STDOUT_FILENO, io.out);
+            write_all(STDERR_FILENO, io.err);
+            return status;
+        }};
+        pid_t pid = launch_process(spec);
         if (pid == -1) {
-            std::cerr << "Fork failed\n";
-            return;
+            LOG_ERRORF("fork for builtin %s failed: %s", std::string(builtin->name).c_str(), strerror(errno));
+            write_stderr(ctx, std::string("Fork failed: ") + strerror(errno) + "\n");
+        } else if (tracing()) {
+            trace_span("fork", start, monotonic_ns(), pid, builtin->name);
         }
+        return pid;
+    }
 
-        if (pid == 0) {
-            if (i > 0) {
-                dup2(pipe_fds[(i-1)*2], STDIN_FILENO);
-                close(pipe_fds[(i-1)*2]);
-                close(pipe_fds[(i-1)*2 + 1]);
-            }
+    CommandHash& command_hash = ctx.command_hash;
+    std::string name(command.tokens[0]);
+    std::string path = command_hash.lookup(name);
+    if (path.empty()) {
+        write_stderr(ctx, name + ": command not found\n");
+        return -1;
+    }
 
-            if (i < cmd.commands.size() - 1) {
-                dup2(pipe_fds[i*2 + 1], STDOUT_FILENO);
-                close(pipe_fds[i*2]);
-                close(pipe_fds[i*2 + 1]);
-            }
+    std::vector<char*> args;
+    for (const auto& token : command.tokens) {
+        args.push_back(const_cast<char*>(token.data()));
+    }
+    args.push_back(nullptr);
 
-            for (size_t j = 0; j < pipe_fds.size(); ++j) {
-                close(pipe_fds[j]);
-            }
+    LaunchSpec spec{path.c_str(), args.data(), in_fd, out_fd, ctx.stderr_fd, pgid, nullptr};
+    pid_t pid = launch_process(spec);
+    if (pid == -1 && errno == ENOENT && path != name) {
+        // The hashed binary went away; search PATH again once.
+        command_hash.forget(name);
+        path = command_hash.lookup(name);
+        if (!path.empty()) {
+            spec.path = path.c_str();
+            pid = launch_process(spec);
+        } else {
+            errno = ENOENT;
+        }
+    }
+    if (pid == -1) {
+        LOG_ERRORF("launching %s failed: %s", path.c_str(), strerror(errno));
+        write_stderr(ctx, name + ": " + strerror(errno) + "\n");
+    } else if (tracing()) {
+        trace_span("spawn", start, monotonic_ns(), pid, path);
+    }
+    return pid;
+}
 
-            const auto& command = cmd.commands[i];
-            if (!command.input_file.empty()) {
-                int fd = open(command.input_file.c_str(), O_RDONLY);
-                if (fd == -1) {
-                    std::cerr << "Failed to open input file: " << command.input_file << "\n";
-                    exit(1);
-                }
-                dup2(fd, STDIN_FILENO);
-                close(fd);
-            }
+// finished, if given, receives a copy of the job once it completes so
+// its resource usage can be reported.
+static int run_pipeline(const ParsedCommand& cmd, const std::vector<Command>& commands, std::string_view text,
+                        ShellContext& ctx, Job* finished) {
+    if (commands.size() == 1 && !commands[0].is_background && commands[0].subshell == 0) {
+        const Builtin* builtin = find_builtin(commands[0].tokens[0]);
+        if (builtin && !builtin->streams && (builtin->pure || ctx.substitution_depth == 0)) {
+            return run_builtin(*builtin, commands[0], ctx);
+        }
+    }
+
+    JobControl& job_control = ctx.job_control;
+    bool is_background = commands.back().is_background;
+    Job* job = nullptr;
+    // Only an interactive shell puts each pipeline in its own group, and not
+    // for a $(...) body: that runs under the command line being expanded,
+    // which must keep the terminal and should not be announced as a job.
+    bool own_group = job_control.is_interactive() && ctx.substitution_depth == 0;
+    pid_t pgid = own_group ? 0 : -1;
+    pid_t last_pid = -1;
+    int prev_read = -1;
 
-            if (!command.output_file.empty()) {
-                int fd = open(command.output_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
-                if (fd == -1) {
-                    std::cerr << "Failed to open output file: " << command.output_file << "\n";
-                    exit(1);
+    for (size_t i = 0; i < commands.size(); ++i) {
+        const auto& command = commands[i];
+        bool is_last = i == commands.size() - 1;
+
+        int pipefd[2] = {-1, -1};
+        if (!is_last) {
+            if (pipe2(pipefd, O_CLOEXEC) == -1) {
+                LOG_ERRORF("pipe2 for stage %zu failed: %s", i, strerror(errno));
+                write_stderr(ctx, "Pipe failed\n");
+                if (prev_read != -1) {
+                    close(prev_read);
                 }
-                dup2(fd, STDOUT_FILENO);
-                close(fd);
+                break;
             }
+            set_pipe_size(pipefd[1], ctx.pipe_size);
+        }
 
-            std::vector<char*> args;
-            for (const auto& token : command.tokens) {
-                args.push_back(const_cast<char*>(token.c_str()));
-            }
-            args.push_back(nullptr);
+        int in_fd = prev_read != -1 ? prev_read : ctx.stdin_fd;
+        int out_fd = is_last ? ctx.stdout_fd : pipefd[1];
+        int input_fd = -1;
+        int output_fd = -1;
+        bool ready = true;
 
-            execvp(args[0], args.data());
-            std::cerr << "execvp failed: " << strerror(errno) << "\n";
-            exit(1);
-        } else {
-            std::cout << "[" << (i + 1) << "] " << pid << " ";
-            for (const auto& token : cmd.commands[i].tokens) {
-                std::cout << token << " ";
+        if (!command.input_file.empty()) {
+            input_fd = open(command.input_file.data(), O_RDONLY | O_CLOEXEC);
+            if (input_fd == -1) {
+                write_stderr(ctx, "Failed to open input file: " + std::string(command.input_file) + "\n");
+                ready = false;
             }
-            if (!cmd.commands[i].input_file.empty()) {
-                std::cout << "< " << cmd.commands[i].input_file << " ";
-            }
-            if (!cmd.commands[i].output_file.empty()) {
-                std::cout << "> " << cmd.commands[i].output_file << " ";
-            }
-            if (cmd.commands[i].is_background) {
-                std::cout << "& ";
+            in_fd = input_fd;
+        }
+
+        if (ready && !command.output_file.empty()) {
+            output_fd = open(command.output_file.data(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (output_fd == -1) {
+                write_stderr(ctx, "Failed to open output file: " + std::string(command.output_file) + "\n");
+                ready = false;
             }
-            std::cout << "\n";
+            out_fd = output_fd;
+        }
 
-            pids.push_back(pid);
-            job_control.add_job(pid, cmd.commands[i].tokens[0]);
+        pid_t pid = -1;
+        if (ready) {
+            pid = launch_stage(cmd, command, in_fd, out_fd, pgid, ctx);
+        }
 
-            if (i > 0) {
-                close(pipe_fds[(i-1)*2]);
-                close(pipe_fds[(i-1)*2 + 1]);
+        for (int fd : {input_fd, output_fd, prev_read, pipefd[1]}) {
+            if (fd != -1) {
+                close(fd);
             }
+        }
+        prev_read = pipefd[0];
 
-            setpgid(pid, pids[0]);
-            std::cout << "Parent set PGID for PID " << pid << " to " << pids[0] << "\n";
-            if (i == cmd.commands.size() - 1 && !cmd.commands[i].is_background) {
-                job_control.set_foreground(pid);
+        if (pid == -1) {
+            continue;
+        }
+        if (!job) {
+            job = &job_control.create_job(pgid > 0 ? pgid : pid, std::string(text), is_background, own_group);
+        }
+        LOG_DEBUGF("stage %zu: %s started as pid %d in pgid %d", i, stage_name(command), pid,
+                   pgid > 0 ? pgid : pgid == 0 ? pid : getpgrp());
+        if (pgid == 0) {
+            pgid = pid;
+        }
+        if (is_last) {
+            last_pid = pid;
+        }
+        job_control.add_process(*job, pid, stage_name(command));
+    }
+
+    if (prev_read != -1) {
+        close(prev_read);
+    }
+
+    if (!job) {
+        return 127;
+    }
+    if (is_background) {
+        if (own_group) {
+            std::cout << "[" << job->job_id << "] " << job->processes.back().pid << "\n";
+        }
+        return 0;
+    }
+    int status = job_control.wait_for_job(*job, false, finished);
+    return last_pid == -1 ? 127 : status;
+}
+
+static void append_seconds(std::string& out, const char* label, double seconds) {
+    char line[64];
+    int minutes = static_cast<int>(seconds / 60);
+    snprintf(line, sizeof(line), "%s\t%dm%.6fs\n", label, minutes, seconds - minutes * 60);
+    out += line;
+}
+
+static double rusage_seconds(const struct timeval& tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// `time pipeline`: runs the pipeline, then reports real/user/sys for the
+// whole job on stderr followed by a per-process breakdown. A pipeline
+// that ran entirely inside the shell is charged the shell's own usage.
+static int run_timed(const ParsedCommand& cmd, const std::vector<Command>& line, std::string_view text,
+                     ShellContext& ctx) {
+    std::vector<Command> commands = line;
+    commands[0].tokens.erase(commands[0].tokens.begin());
+    text.remove_prefix(std::min(text.find("time") + 4, text.size()));
+    text.remove_prefix(std::min(text.find_first_not_of(" \t"), text.size()));
+
+    struct rusage self_before;
+    getrusage(RUSAGE_SELF, &self_before);
+    uint64_t start = monotonic_ns();
+    Job finished{};
+    int status = 0;
+    if (!commands[0].tokens.empty()) {
+        status = run_pipeline(cmd, commands, text, ctx, &finished);
+    } else if (commands.size() > 1) {
+        write_stderr(ctx, "Invalid command\n");
+        return 2;
+    }
+    if (commands.back().is_background) {
+        return status;
+    }
+    double real = (monotonic_ns() - start) / 1e9;
+
+    double user = 0;
+    double sys = 0;
+    if (finished.processes.empty()) {
+        struct rusage self_after;
+        getrusage(RUSAGE_SELF, &self_after);
+        user = rusage_seconds(self_after.ru_utime) - rusage_seconds(self_before.ru_utime);
+        sys = rusage_seconds(self_after.ru_stime) - rusage_seconds(self_before.ru_stime);
+    } else {
+        for (const auto& process : finished.processes) {
+            user += rusage_seconds(process.usage.ru_utime);
+            sys += rusage_seconds(process.usage.ru_stime);
+        }
+    }
+
+    std::string report = "\n";
+    append_seconds(report, "real", real);
+    append_seconds(report, "user", user);
+    append_seconds(report, "sys", sys);
+    format_job_usage(finished, report);
+    write_stderr(ctx, report);
+    return status;
+}
+
+// The last command of a subshell or of `-c`: nothing runs after it in
+// this process, so the process becomes the command instead of forking a
+// child and waiting for it. Returns only if that fails.
+static int exec_stage(const Command& command, ShellContext& ctx) {
+    std::string name(command.tokens[0]);
+    std::string path = ctx.command_hash.lookup(name);
+    if (path.empty()) {
+        write_stderr(ctx, name + ": command not found\n");
+        return 127;
+    }
+    int in_fd = ctx.stdin_fd;
+    if (!command.input_file.empty()) {
+        in_fd = open(command.input_file.data(), O_RDONLY | O_CLOEXEC);
+        if (in_fd == -1) {
+            write_stderr(ctx, "Failed to open input file: " + std::string(command.input_file) + "\n");
+            return 1;
+        }
+    }
+    int out_fd = ctx.stdout_fd;
+    if (!command.output_file.empty()) {
+        out_fd = open(command.output_file.data(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (out_fd == -1) {
+            write_stderr(ctx, "Failed to open output file: " + std::string(command.output_file) + "\n");
+            if (in_fd != ctx.stdin_fd) {
+                close(in_fd);
             }
+            return 1;
         }
     }
+    std::vector<char*> args;
+    for (const auto& token : command.tokens) {
+        args.push_back(const_cast<char*>(token.data()));
+    }
+    args.push_back(nullptr);
 
-    for (int fd : pipe_fds) {
-        if (fd != -1) {
-            close(fd);
+    LOG_DEBUGF("exec %s in place of pid %d", path.c_str(), getpid());
+    log_flush();
+    LaunchSpec spec{path.c_str(), args.data(), in_fd, out_fd, ctx.stderr_fd, -1, nullptr};
+    exec_process(spec);
+    if (errno == ENOENT && path != name) {
+        // The hashed binary went away; search PATH again once.
+        ctx.command_hash.forget(name);
+        path = ctx.command_hash.lookup(name);
+        if (!path.empty()) {
+            spec.path = path.c_str();
+            exec_process(spec);
+        } else {
+            errno = ENOENT;
         }
     }
+    int error = errno;
+    if (in_fd != ctx.stdin_fd) {
+        close(in_fd);
+    }
+    if (out_fd != ctx.stdout_fd) {
+        close(out_fd);
+    }
+    write_stderr(ctx, name + ": " + strerror(error) + "\n");
+    return error == ENOENT ? 127 : 126;
+}
+
+static int dispatch(const ParsedCommand& cmd, const std::vector<Command>& commands, std::string_view text,
+                    ShellContext& ctx, bool exec_tail) {
+    const Command& first = commands[0];
+    if (first.subshell == 0 && first.tokens[0] == "time") {
+        return run_timed(cmd, commands, text, ctx);
+    }
+    if (exec_tail && commands.size() == 1 && first.subshell == 0 && !first.is_background &&
+        !find_builtin(first.tokens[0])) {
+        return exec_stage(first, ctx);
+    }
+    return run_pipeline(cmd, commands, text, ctx, nullptr);
+}
+
+static int run_and_expand(const ParsedCommand& cmd, const Pipeline& pipeline, ShellContext& ctx, bool exec_tail) {
+    if (!has_substitutions(pipeline.commands)) {
+        return dispatch(cmd, pipeline.commands, pipeline.text, ctx, exec_tail);
+    }
+    // A pipeline that expands to nothing keeps the status of its last
+    // substitution, as in sh.
+    Expansion expansion;
+    int status = ctx.last_status;
+    if (expand_substitutions(pipeline.commands, ctx, expansion)) {
+        status = dispatch(cmd, expansion.commands, pipeline.text, ctx, exec_tail);
+    }
+    release_expansion(expansion, ctx);
+    return status;
+}
 
-    if (!cmd.commands.back().is_background) {
-        for (pid_t pid : pids) {
-            int status;
-            waitpid(pid, &status, WUNTRACED);
-            job_control.remove_job(pid);
+// Substitutions are expanded as each pipeline is reached, so they see
+// the effects of the ones before it ("cd src && echo $(pwd)").
+static int run_list(const ParsedCommand& cmd, size_t list, ShellContext& ctx, bool exec_tail) {
+    const std::vector<Pipeline>& pipelines = cmd.lists[list];
+    int status = 0;
+    for (size_t i = 0; i < pipelines.size() && ctx.running; ++i) {
+        const Pipeline& pipeline = pipelines[i];
+        if ((pipeline.connector == Connector::IfSuccess && status != 0) ||
+            (pipeline.connector == Connector::IfFailure && status == 0)) {
+            continue;
+        }
+        status = run_and_expand(cmd, pipeline, ctx, exec_tail && i + 1 == pipelines.size());
+        ctx.last_status = status;
+        if (ctx.interactive && status == 128 + SIGINT) {
+            break; // Ctrl-C abandons the rest of the line
         }
     }
+    return status;
+}
+
+int execute_command(const ParsedCommand& cmd, ShellContext& ctx, bool exec_tail) {
+    if (cmd.empty()) {
+        return 0;
+    }
+    return run_list(cmd, 0, ctx, exec_tail);
 }
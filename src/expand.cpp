@@ -0,0 +1,207 @@
+#include "expand.h"
+#include "builtins.h"
+#include "capture.h"
+#include "io_util.h"
+
+namespace {
+
+struct Span {
+    size_t start;
+    size_t length;
+};
+
+// A substitution in the word being rebuilt, with its captured output.
+struct Splice {
+    const Substitution* sub;
+    const std::string* output;
+};
+
+const size_t no_span = static_cast<size_t>(-1);
+
+bool is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\n';
+}
+
+// Appends word to arena with the outputs of subs spliced in, pushing
+// one span per resulting word. Unquoted output is split on blanks when
+// split is set; pieces left empty by expansion alone are dropped.
+void build_word(std::string_view word, const std::vector<Splice>& splices, bool split, std::string& arena,
+                std::vector<Span>& spans) {
+    size_t start = arena.size();
+    bool keep = false;
+    auto finish = [&]() {
+        if (arena.size() > start || keep) {
+            spans.push_back(Span{start, arena.size() - start});
+            arena += '\0';
+        }
+        start = arena.size();
+        keep = false;
+    };
+
+    size_t pos = 0;
+    for (const Splice& splice : splices) {
+        if (splice.sub->offset > pos) {
+            arena.append(word.substr(pos, splice.sub->offset - pos));
+            keep = true;
+        }
+        pos = splice.sub->offset;
+        const std::string& output = *splice.output;
+        if (splice.sub->quoted || !split) {
+            arena += output;
+            keep = true;
+            continue;
+        }
+        size_t i = 0;
+        while (i < output.size()) {
+            if (is_blank(output[i])) {
+                finish();
+                while (i < output.size() && is_blank(output[i])) {
+                    i++;
+                }
+                continue;
+            }
+            size_t end = i;
+            while (end < output.size() && !is_blank(output[end])) {
+                end++;
+            }
+            arena.append(output, i, end - i);
+            i = end;
+        }
+    }
+    if (pos < word.size()) {
+        arena.append(word.substr(pos));
+        keep = true;
+    }
+    finish();
+}
+
+} // namespace
+
+bool has_substitutions(const std::vector<Command>& commands) {
+    for (const auto& command : commands) {
+        if (!command.substitutions.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int capture_output(std::string_view source, ShellContext& ctx, std::string& out) {
+    ParsedCommand parsed = parse_command(source);
+    const Builtin* builtin = nullptr;
+    if (const Command* single = parsed.single_command()) {
+        const Command& only = *single;
+        bool name_is_literal = only.substitutions.empty() || only.substitutions[0].target != Substitution::Token ||
+                               only.substitutions[0].token != 0;
+        if (!only.is_background && only.input_file.empty() && only.output_file.empty() && name_is_literal) {
+            builtin = find_builtin(only.tokens[0]);
+        }
+    }
+
+    int status = 0;
+    if (builtin && builtin->pure) {
+        Expansion expansion;
+        const std::vector<Command>* commands = &parsed.lists[0][0].commands;
+        if (has_substitutions(*commands)) {
+            expand_substitutions(parsed.lists[0][0].commands, ctx, expansion);
+            commands = &expansion.commands;
+        }
+        BuiltinIO io;
+        io.out = std::move(out);
+        io.in_fd = ctx.stdin_fd;
+        io.out_fd = -1;
+        status = builtin->run(ctx, commands->front().tokens, io);
+        out = std::move(io.out);
+        write_all(ctx.stderr_fd, io.err);
+        release_expansion(expansion, ctx);
+    } else {
+        ctx.substitution_depth++;
+        status = execute_captured(parsed, ctx, out, nullptr);
+        ctx.substitution_depth--;
+    }
+
+    size_t end = out.find_last_not_of('\n');
+    out.resize(end == std::string::npos ? 0 : end + 1);
+    return status;
+}
+
+bool expand_substitutions(const std::vector<Command>& commands, ShellContext& ctx, Expansion& expansion) {
+    // Run everything first: later substitutions may depend on the side
+    // effects of earlier ones, and the outputs must outlive the build.
+    std::vector<std::string> outputs;
+    for (const auto& command : commands) {
+        for (const auto& sub : command.substitutions) {
+            outputs.push_back(ctx.buffers.acquire());
+            ctx.last_status = capture_output(sub.command, ctx, outputs.back());
+        }
+    }
+
+    expansion.arena = ctx.buffers.acquire();
+    std::string& arena = expansion.arena;
+    std::vector<std::vector<Span>> token_spans(commands.size());
+    std::vector<Span> input_spans(commands.size(), Span{no_span, 0});
+    std::vector<Span> output_spans(commands.size(), Span{no_span, 0});
+    size_t next_output = 0;
+    std::vector<Splice> splices;
+    std::vector<Span> spans;
+    for (size_t c = 0; c < commands.size(); ++c) {
+        const Command& command = commands[c];
+        auto collect = [&](Substitution::Target target, size_t token) {
+            splices.clear();
+            for (size_t s = 0; s < command.substitutions.size(); ++s) {
+                const Substitution& sub = command.substitutions[s];
+                if (sub.target == target && (target != Substitution::Token || sub.token == token)) {
+                    splices.push_back(Splice{&sub, &outputs[next_output + s]});
+                }
+            }
+        };
+        for (size_t t = 0; t < command.tokens.size(); ++t) {
+            collect(Substitution::Token, t);
+            build_word(command.tokens[t], splices, true, arena, token_spans[c]);
+        }
+        // Redirection targets are never split.
+        collect(Substitution::InputFile, 0);
+        if (!splices.empty()) {
+            spans.clear();
+            build_word(command.input_file, splices, false, arena, spans);
+            input_spans[c] = spans.front();
+        }
+        collect(Substitution::OutputFile, 0);
+        if (!splices.empty()) {
+            spans.clear();
+            build_word(command.output_file, splices, false, arena, spans);
+            output_spans[c] = spans.front();
+        }
+        next_output += command.substitutions.size();
+    }
+    for (auto& output : outputs) {
+        ctx.buffers.release(std::move(output));
+    }
+
+    // The arena is complete, so views into it are now stable.
+    bool runnable = true;
+    for (size_t c = 0; c < commands.size(); ++c) {
+        Command command;
+        command.is_background = commands[c].is_background;
+        command.subshell = commands[c].subshell;
+        command.input_file = commands[c].input_file;
+        command.output_file = commands[c].output_file;
+        for (const Span& span : token_spans[c]) {
+            command.tokens.emplace_back(arena.data() + span.start, span.length);
+        }
+        if (input_spans[c].start != no_span) {
+            command.input_file = std::string_view(arena.data() + input_spans[c].start, input_spans[c].length);
+        }
+        if (output_spans[c].start != no_span) {
+            command.output_file = std::string_view(arena.data() + output_spans[c].start, output_spans[c].length);
+        }
+        runnable = runnable && (!command.tokens.empty() || command.subshell != 0);
+        expansion.commands.push_back(std::move(command));
+    }
+    return runnable;
+}
+
+void release_expansion(Expansion& expansion, ShellContext& ctx) {
+    expansion.commands.clear();
+    ctx.buffers.release(std::move(expansion.arena));
+}
@@ -1,248 +1,411 @@
 #include "fusionshell.h"
 #include "parser.h"
 #include "executor.h"
+#include "log.h"
+#include "time_util.h"
+#include "trace.h"
+#include <cstdlib>
 #include <iostream>
 #include <signal.h>
-#include <sstream>
-#include <sys/wait.h>
 #include <termios.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <fstream>
 #include <algorithm>
 #include <cstring>
 #include <cerrno>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
 
-static FusionShell* shell_instance = nullptr;
 static struct termios orig_termios;
 
-History::History() : max_size(1000), current_index(0), history_file("/home/aditiubuntu/.fusionshell_history") {
-    load_history();
-}
+// How long one keystroke may spend scanning history before the partial
+// Ctrl-R results are drawn and input is polled again.
+static const uint64_t search_slice_ns = 500 * 1000;
 
-void History::load_history() {
-    std::ifstream file(history_file);
-    if (!file.is_open()) {
-        std::cerr << "Failed to open history file for reading: " << history_file << "\n";
-        return;
+FusionShell::FusionShell(bool interactive)
+    : ctx(interactive), history(interactive ? History() : History(1, "")), renderer(STDOUT_FILENO),
+      tab_pressed(false), searching(false), search_pick(0), escape_timer(-1), escape_timed_out(false),
+      input_closed(false) {
+    const char* trace = getenv("FUSIONSHELL_TRACE");
+    if (trace && *trace && strcmp(trace, "0") != 0) {
+        trace_set_enabled(true);
     }
-    std::string line;
-    while (std::getline(file, line) && commands.size() < max_size) {
-        if (!line.empty()) {
-            commands.push_back(line);
+    if (interactive) {
+        setpgid(0, 0);
+        tcsetpgrp(STDIN_FILENO, getpid());
+        setup_signal_handlers();
+        events.add_fd(STDIN_FILENO, EPOLLIN, [this](uint32_t) {
+            char buf[4096];
+            ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+            if (n > 0) {
+                decoder.feed(buf, n);
+            } else if (n == 0 || (errno != EINTR && errno != EAGAIN)) {
+                input_closed = true;
+            }
+        });
+        escape_timer = events.add_timer([this]() { escape_timed_out = true; });
+        completer.emplace();
+        if (completer->fd() != -1) {
+            events.add_fd(completer->fd(), EPOLLIN, [this](uint32_t) { completer->handle_events(); });
         }
     }
-    current_index = commands.size();
 }
 
-void History::save_history() {
-    std::ofstream file(history_file, std::ios::out | std::ios::trunc);
-    if (!file.is_open()) {
-        std::cerr << "Failed to save history to " << history_file << ": " << strerror(errno) << "\n";
+void FusionShell::setup_signal_handlers() {
+    signal(SIGINT, SIG_IGN);
+    signal(SIGTSTP, SIG_IGN);
+    signal(SIGTTIN, SIG_IGN);
+    signal(SIGTTOU, SIG_IGN);
+    // SIGCHLD is blocked and read from a signalfd, so children are only
+    // reaped from the event loop while the prompt is up, never while the
+    // executor is waiting on a foreground job.
+    events.watch_signal(SIGCHLD, [this](const signalfd_siginfo&) { ctx.job_control.reap_children(); });
+}
+
+void FusionShell::enable_raw_mode() {
+    tcgetattr(STDIN_FILENO, &orig_termios);
+    struct termios raw = orig_termios;
+    raw.c_lflag &= ~(ICANON | ISIG | ECHO);
+    raw.c_iflag &= ~(IXON | ICRNL | INLCR | IGNCR);
+    raw.c_oflag &= ~(OPOST);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1) {
+        LOG_WARNF("cannot set raw mode: %s", strerror(errno));
         return;
     }
-    for (const auto& cmd : commands) {
-        file << cmd << "\n";
-    }
-    file.close();
-    std::cerr << "History saved to " << history_file << "\n";
+    renderer.write_raw("\033[?2004h"); // bracketed paste on
 }
 
-void History::add_command(const std::string& cmd) {
-    if (cmd.empty() || (commands.size() > 0 && commands.back() == cmd)) {
-        return;
+void FusionShell::disable_raw_mode() {
+    if (isatty(STDOUT_FILENO)) {
+        renderer.write_raw("\033[?2004l");
     }
-    commands.push_back(cmd);
-    if (commands.size() > max_size) {
-        commands.erase(commands.begin());
+    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios) == -1) {
+        LOG_WARNF("cannot restore terminal modes: %s", strerror(errno));
     }
-    current_index = commands.size();
-    save_history();
 }
 
-std::string History::get_prev_command() {
-    if (commands.empty() || current_index == 0) {
-        return "";
+void FusionShell::insert_text(std::string& input, size_t& cursor_pos, const std::string& text) {
+    std::string clean;
+    clean.reserve(text.size());
+    for (char c : text) {
+        if (c == '\n' || c == '\r' || c == '\t') {
+            clean += ' ';
+        } else if (std::isprint(static_cast<unsigned char>(c))) {
+            clean += c;
+        }
     }
-    return commands[--current_index];
+    input.insert(cursor_pos, clean);
+    lexer.update(input, cursor_pos, 0, clean.size());
+    cursor_pos += clean.size();
 }
 
-std::string History::get_next_command() {
-    if (current_index >= commands.size()) {
-        return "";
+void FusionShell::show_search_pick(std::string& input, size_t& cursor_pos) {
+    const auto& results = search.results();
+    if (results.empty()) {
+        return;
     }
-    return commands[current_index++];
+    search_pick = std::min(search_pick, results.size() - 1);
+    const HistoryRing& entries = history.entries();
+    std::string_view match = entries.at(results[search_pick].seq - entries.front_seq());
+    if (input != match) {
+        input.assign(match.data(), match.size());
+        lexer.reset(input);
+    }
+    cursor_pos = input.size();
 }
 
-std::string History::get_suggestion(const std::string& prefix) {
-    if (prefix.empty()) {
-        return "";
-    }
-    for (const auto& cmd : commands) {
-        if (cmd.size() >= prefix.size() && cmd.substr(0, prefix.size()) == prefix) {
-            return cmd;
+std::string FusionShell::search_prompt() const {
+    bool failed = search.finished() && search.results().empty() && !search.query().empty();
+    return std::string(failed ? "(failed search)`" : "(search)`") + search.query() + "': ";
+}
+
+// Ctrl-R mode: keys edit the query and the line shows the chosen match.
+// Ctrl-R or Up steps to the next-best match, Down back; Enter runs it,
+// Ctrl-C/Ctrl-G restore the original line, and any other key keeps the
+// match for editing.
+bool FusionShell::apply_search_key(const Key& key, std::string& input, size_t& cursor_pos) {
+    const std::string& query = search.query();
+    switch (key.type) {
+    case KeyType::Enter:
+        searching = false;
+        return true;
+    case KeyType::CtrlR:
+    case KeyType::Up:
+        search_pick++;
+        break;
+    case KeyType::Down:
+        if (search_pick > 0) {
+            search_pick--;
+        }
+        break;
+    case KeyType::Backspace:
+        if (!query.empty()) {
+            search.set_query(history.entries(), std::string_view(query).substr(0, query.size() - 1));
+            search_pick = 0;
+        }
+        break;
+    case KeyType::Char:
+        search.set_query(history.entries(), query + key.ch);
+        search_pick = 0;
+        break;
+    case KeyType::Paste: {
+        std::string text = query;
+        for (char c : decoder.paste_text()) {
+            if (std::isprint(static_cast<unsigned char>(c))) {
+                text += c;
+            }
         }
+        search.set_query(history.entries(), text);
+        search_pick = 0;
+        break;
+    }
+    case KeyType::CtrlC:
+    case KeyType::CtrlG:
+        searching = false;
+        input = search_saved;
+        cursor_pos = input.size();
+        lexer.reset(input);
+        return false;
+    default:
+        searching = false;
+        return false;
     }
-    return "";
+    show_search_pick(input, cursor_pos);
+    return false;
 }
 
-FusionShell::FusionShell() : running(true), job_control(), history() {
-    shell_instance = this;
-    setpgid(0, 0);
-    tcsetpgrp(STDIN_FILENO, getpid());
-    setup_signal_handlers();
+static bool word_break(char c) {
+    return std::isspace(static_cast<unsigned char>(c)) || c == '|' || c == '<' || c == '>' || c == '&';
 }
 
-void FusionShell::setup_signal_handlers() {
-    signal(SIGINT, SIG_IGN);
-    signal(SIGTSTP, SIG_IGN);
-    signal(SIGTTIN, SIG_IGN);
-    signal(SIGTTOU, SIG_IGN);
-    signal(SIGCHLD, [](int) {
-        pid_t pid;
-        int status;
-        while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED | WCONTINUED)) > 0) {
-            if (shell_instance) {
-                shell_instance->job_control.handle_child_signal(pid, status);
+static bool needs_escape(char c) {
+    return word_break(c) || strchr("'\"\\;()$`*?", c) != nullptr;
+}
+
+// Completes the word that ends at the cursor: a command name in command
+// position, otherwise a path. Inserts what every candidate shares; when
+// that adds nothing and list is set (a second Tab), prints the choices.
+void FusionShell::complete_word(std::string& input, size_t& cursor_pos, bool list) {
+    size_t start = cursor_pos;
+    while (start > 0 && (!word_break(input[start - 1]) || (start > 1 && input[start - 2] == '\\'))) {
+        start--;
+    }
+    std::string word;
+    for (size_t i = start; i < cursor_pos; ++i) {
+        if (input[i] == '\\' && i + 1 < cursor_pos) {
+            i++;
+        }
+        word += input[i];
+    }
+
+    CompletionResult result;
+    if (lexer.class_at(start) == TokenClass::Command && word.find('/') == std::string::npos) {
+        completer->complete_command(word, result);
+    } else {
+        completer->complete_file(word, result);
+    }
+    if (result.count == 0) {
+        renderer.write_raw("\a");
+        return;
+    }
+
+    if (result.count == 1 || result.common.size() > word.size()) {
+        std::string text;
+        for (char c : result.common) {
+            if (needs_escape(c)) {
+                text += '\\';
+            }
+            text += c;
+        }
+        if (result.count == 1 && !result.directory) {
+            text += ' ';
+        }
+        size_t old_len = cursor_pos - start;
+        input.replace(start, old_len, text);
+        lexer.update(input, start, old_len, text.size());
+        cursor_pos = start + text.size();
+        return;
+    }
+    if (!list) {
+        renderer.write_raw("\a");
+        return;
+    }
+
+    // Column layout for the terminal width; raw mode needs \r\n.
+    struct winsize ws;
+    size_t columns = ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0 ? ws.ws_col : 80;
+    size_t width = 0;
+    for (const auto& name : result.shown) {
+        width = std::max(width, name.size() + 2);
+    }
+    size_t per_row = std::max<size_t>(1, columns / width);
+    size_t rows = (result.shown.size() + per_row - 1) / per_row;
+    std::string text = "\r\n";
+    for (size_t row = 0; row < rows; ++row) {
+        for (size_t col = 0; col < per_row; ++col) {
+            size_t i = col * rows + row;
+            if (i >= result.shown.size()) {
+                break;
+            }
+            text += result.shown[i];
+            if (col + 1 < per_row && i + rows < result.shown.size()) {
+                text.append(width - result.shown[i].size(), ' ');
             }
         }
-    });
+        text += "\r\n";
+    }
+    if (result.count > result.shown.size()) {
+        text += "... and " + std::to_string(result.count - result.shown.size()) + " more\r\n";
+    }
+    renderer.write_raw(text);
 }
 
-void FusionShell::enable_raw_mode() {
-    tcgetattr(STDIN_FILENO, &orig_termios);
-    struct termios raw = orig_termios;
-    raw.c_lflag &= ~(ICANON | ISIG | ECHO);
-    raw.c_iflag &= ~(IXON | ICRNL | INLCR | IGNCR);
-    raw.c_oflag &= ~(OPOST);
-    raw.c_cc[VMIN] = 1;
-    raw.c_cc[VTIME] = 0;
-    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1) {
-        std::cerr << "Failed to set raw mode: " << strerror(errno) << "\n";
+bool FusionShell::apply_key(const Key& key, std::string& input, size_t& cursor_pos) {
+    if (searching) {
+        return apply_search_key(key, input, cursor_pos);
+    }
+    bool second_tab = key.type == KeyType::Tab && tab_pressed;
+    tab_pressed = key.type == KeyType::Tab;
+    switch (key.type) {
+    case KeyType::Enter:
+        return true;
+    case KeyType::Tab:
+        complete_word(input, cursor_pos, second_tab);
+        break;
+    case KeyType::Backspace:
+        if (!input.empty() && cursor_pos > 0) {
+            input.erase(cursor_pos - 1, 1);
+            cursor_pos--;
+            lexer.update(input, cursor_pos, 1, 0);
+        }
+        break;
+    case KeyType::CtrlC:
+        renderer.write_raw("^C\r\n");
+        input.clear();
+        cursor_pos = 0;
+        lexer.reset(input);
+        break;
+    case KeyType::CtrlR:
+        searching = true;
+        search_pick = 0;
+        search_saved = input;
+        search.reset();
+        break;
+    case KeyType::Up: {
+        std::string prev = history.get_prev_command();
+        if (!prev.empty()) {
+            input = prev;
+            cursor_pos = input.size();
+            lexer.reset(input);
+        }
+        break;
+    }
+    case KeyType::Down:
+        input = history.get_next_command();
+        cursor_pos = input.size();
+        lexer.reset(input);
+        break;
+    case KeyType::Right:
+        if (cursor_pos == input.size()) {
+            std::string suggestion = history.get_suggestion(input);
+            if (!suggestion.empty()) {
+                input = suggestion;
+                cursor_pos = input.size();
+                lexer.reset(input);
+            }
+        }
+        break;
+    case KeyType::Char:
+        input.insert(cursor_pos, 1, key.ch);
+        lexer.update(input, cursor_pos, 0, 1);
+        cursor_pos++;
+        break;
+    case KeyType::Paste:
+        insert_text(input, cursor_pos, decoder.paste_text());
+        break;
+    default:
+        break;
     }
+    return false;
 }
 
-void FusionShell::disable_raw_mode() {
-    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_termios) == -1) {
-        std::cerr << "Failed to restore terminal: " << strerror(errno) << "\n";
+void FusionShell::show_notifications() {
+    std::string text = ctx.job_control.take_notifications();
+    if (text.empty()) {
+        return;
+    }
+    // Raw mode has output post-processing off, so lines need \r\n.
+    std::string frame = "\r\033[K";
+    for (char c : text) {
+        if (c == '\n') {
+            frame += '\r';
+        }
+        frame += c;
     }
+    renderer.write_raw(frame);
 }
 
-// In fusionshell.cpp, replace the read_input function with this version
 std::string FusionShell::read_input() {
     enable_raw_mode();
+    const std::string prompt = "fusionshell> ";
     std::string input;
     std::string suggestion;
-    std::string displayed_suggestion;
     size_t cursor_pos = 0;
+    bool done = false;
 
     tcflush(STDIN_FILENO, TCIFLUSH);
-    std::cout << "fusionshell> ";
     std::cout.flush();
-
-    // ANSI color codes
-    const std::string COLOR_RESET = "\033[0m";
-    const std::string COLOR_COMMAND = "\033[32m"; // Green
-    const std::string COLOR_ARG = "\033[33m";    // Yellow
-    const std::string COLOR_OP = "\033[31m";     // Red
-    const std::string COLOR_FILE = "\033[34m";   // Blue
-    const std::string COLOR_SUGGEST = "\033[90m"; // Gray for suggestions
+    lexer.reset(input);
+    renderer.reset();
+    searching = false;
+    // Commands other sessions ran since the last prompt become reachable
+    // with Up, Ctrl-R and suggestions.
+    history.sync();
 
     while (true) {
-        char c;
-        if (read(STDIN_FILENO, &c, 1) <= 0) {
-            if (errno == EINTR) continue;
-            disable_raw_mode();
-            return "";
+        // Apply every key already buffered, then render once.
+        Key key;
+        while (!done && (decoder.next(key) || (escape_timed_out && decoder.flush_partial(key)))) {
+            done = apply_key(key, input, cursor_pos);
         }
+        escape_timed_out = false;
 
-        if (c == '\n' || c == '\r') {
-            std::cout << "\n";
-            break;
-        } else if (c == 127 || c == '\b') { // Backspace
-            if (!input.empty() && cursor_pos > 0) {
-                input.erase(cursor_pos - 1, 1);
-                cursor_pos--;
-            }
-        } else if (c == 3) { // Ctrl+C
-            std::cout << "^C\nfusionshell> ";
-            input.clear();
-            cursor_pos = 0;
-            suggestion.clear();
-            displayed_suggestion.clear();
-            std::cout.flush();
-            continue;
-        } else if (c == 27) { // Escape sequence
-            char seq[3];
-            if (read(STDIN_FILENO, &seq[0], 1) <= 0 || read(STDIN_FILENO, &seq[1], 1) <= 0) {
-                continue;
-            }
-            if (seq[0] == '[') {
-                if (seq[1] == 'A') { // Up arrow
-                    std::string prev = history.get_prev_command();
-                    if (!prev.empty()) {
-                        input = prev;
-                        cursor_pos = input.size();
-                    }
-                } else if (seq[1] == 'B') { // Down arrow
-                    std::string next = history.get_next_command();
-                    input = next.empty() ? "" : next;
-                    cursor_pos = input.size();
-                } else if (seq[1] == 'C' && !suggestion.empty() && cursor_pos == input.size()) { // Right arrow
-                    input = suggestion;
-                    cursor_pos = input.size();
-                }
-            }
-        } else if (std::isprint(c)) {
-            input.insert(cursor_pos, 1, c);
-            cursor_pos++;
+        if (searching && !search.finished()) {
+            search.step(history.entries(), monotonic_ns() + search_slice_ns);
+            show_search_pick(input, cursor_pos);
         }
 
-        // Parse input for syntax highlighting
-        ParsedCommand parsed = parse_command(input);
-        std::cout << "\r\033[Kfusionshell> ";
-
-        // Display input with syntax highlighting
-        bool first_token = true;
-        bool parsing_file = false;
-        char redirection_type = 0;
-
-        for (const auto& cmd : parsed.commands) {
-            for (size_t i = 0; i < cmd.tokens.size(); ++i) {
-                if (i == 0 && first_token) {
-                    std::cout << COLOR_COMMAND << cmd.tokens[i] << COLOR_RESET;
-                    first_token = false;
-                } else {
-                    std::cout << COLOR_ARG << cmd.tokens[i] << COLOR_RESET;
-                }
-                if (i < cmd.tokens.size() - 1) {
-                    std::cout << " ";
-                }
-            }
-            if (!cmd.input_file.empty()) {
-                std::cout << " " << COLOR_OP << "<" << COLOR_RESET << " " << COLOR_FILE << cmd.input_file << COLOR_RESET;
-            }
-            if (!cmd.output_file.empty()) {
-                std::cout << " " << COLOR_OP << ">" << COLOR_RESET << " " << COLOR_FILE << cmd.output_file << COLOR_RESET;
-            }
-            if (cmd.is_background) {
-                std::cout << " " << COLOR_OP << "&" << COLOR_RESET;
-            }
-            if (&cmd != &parsed.commands.back()) {
-                std::cout << " " << COLOR_OP << "|" << COLOR_RESET;
+        show_notifications();
+        std::string_view shown;
+        if (!done && !searching) {
+            suggestion = history.get_suggestion(input);
+            if (suggestion.size() > input.size()) {
+                shown = std::string_view(suggestion).substr(input.size());
             }
-            std::cout << " ";
         }
+        renderer.render(searching ? search_prompt() : prompt, input, lexer.get_tokens(), shown, cursor_pos);
+        if (done) {
+            break;
+        }
+        // Index PATH for Tab only once the prompt is up, so the first
+        // frame does not share the CPU with it.
+        completer->warm_up();
 
-        // Display suggestion
-        suggestion = history.get_suggestion(input);
-        displayed_suggestion = suggestion.empty() ? "" : suggestion.substr(cursor_pos);
-        std::cout << COLOR_SUGGEST << displayed_suggestion << COLOR_RESET;
-
-        // Move cursor to correct position
-        std::cout << "\033[" << (cursor_pos + 11) << "G";
-        std::cout.flush();
+        // A lone ESC: give the rest of a sequence a moment to arrive.
+        if (decoder.has_partial()) {
+            events.arm_timer(escape_timer, 25);
+        }
+        // An unfinished search resumes as soon as no input is waiting.
+        events.run_once(searching && !search.finished() ? 0 : -1);
+        if (input_closed) {
+            ctx.running = false;
+            disable_raw_mode();
+            return "";
+        }
     }
+    renderer.write_raw("\r\n");
 
     disable_raw_mode();
     if (!input.empty()) {
@@ -250,57 +413,79 @@ std::string FusionShell::read_input() {
     }
     return input;
 }
-void FusionShell::run() {
-    while (running) {
-        job_control.restore_terminal_control();
-        std::string input = read_input();
 
-        if (input.empty()) {
-            continue;
-        }
+void FusionShell::execute_line(const std::string& input, bool exec_tail) {
+    uint64_t start = tracing() ? monotonic_ns() : 0;
+    auto parsed = parse_command(input);
+    if (tracing()) {
+        trace_span("parse", start, monotonic_ns(), 0, input);
+    }
+    if (parsed.error) {
+        std::cerr << parsed.error << "\n";
+        ctx.last_status = 2;
+    }
+    if (parsed.empty()) {
+        return;
+    }
+    ctx.last_status = execute_command(parsed, ctx, exec_tail);
+    if (tracing()) {
+        trace_span("command", start, monotonic_ns(), 0, input);
+    }
+}
 
-        auto parsed = parse_command(input);
-        if (parsed.commands.empty()) {
-            continue;
+int FusionShell::run() {
+    while (ctx.running) {
+        ctx.job_control.restore_terminal_control();
+        log_flush();
+        trace_instant("prompt", 0);
+        std::string input = read_input();
+        if (!input.empty()) {
+            execute_line(input);
         }
+    }
+    log_flush();
+    return ctx.last_status;
+}
 
-        bool is_background = !parsed.commands.empty() && parsed.commands.back().is_background;
+void FusionShell::run_script_line(const std::string& line, bool exec_tail) {
+    size_t first = line.find_first_not_of(" \t");
+    if (first == std::string::npos || line[first] == '#') {
+        return;
+    }
+    execute_line(line, exec_tail);
+    ctx.job_control.reap_children();
+    log_flush();
+}
 
-        if (parsed.commands[0].tokens[0] == "exit") {
-            running = false;
-        } else if (parsed.commands[0].tokens[0] == "jobs") {
-            job_control.print_jobs();
-        } else if (parsed.commands[0].tokens[0] == "fg" && parsed.commands[0].tokens.size() > 1) {
-            int job_id;
-            std::stringstream ss(parsed.commands[0].tokens[1]);
-            if (ss >> job_id) {
-                Job* job = job_control.find_job_by_id(job_id);
-                if (job) {
-                    job_control.set_foreground(job->pid);
-                } else {
-                    std::cerr << "No such job: " << job_id << "\n";
-                }
-            } else {
-                std::cerr << "Invalid job ID\n";
-            }
-        } else if (parsed.commands[0].tokens[0] == "bg" && parsed.commands[0].tokens.size() > 1) {
-            int job_id;
-            std::stringstream ss(parsed.commands[0].tokens[1]);
-            if (ss >> job_id) {
-                Job* job = job_control.find_job_by_id(job_id);
-                if (job) {
-                    job->is_background = true;
-                    job->is_stopped = false;
-                    kill(-job->pid, SIGCONT);
-                    std::cout << "[" << job->job_id << "] " << job->command << " &\n";
-                } else {
-                    std::cerr << "No such job: " << job_id << "\n";
-                }
+int FusionShell::run_script(std::istream& in, bool exec_last) {
+    std::string line;
+    while (ctx.running && std::getline(in, line)) {
+        run_script_line(line, exec_last && in.peek() == std::char_traits<char>::eof());
+    }
+    return ctx.last_status;
+}
+
+int FusionShell::run_script_fd(int fd) {
+    std::string line;
+    bool at_eof = false;
+    while (ctx.running && !at_eof) {
+        line.clear();
+        char c;
+        for (;;) {
+            ssize_t n = read(fd, &c, 1);
+            if (n == 1) {
+                if (c == '\n') break;
+                line += c;
+            } else if (n == -1 && errno == EINTR) {
+                continue;
             } else {
-                std::cerr << "Invalid job ID\n";
+                at_eof = true;
+                break;
             }
-        } else {
-            execute_command(parsed, running, job_control);
+        }
+        if (!at_eof || !line.empty()) {
+            run_script_line(line, false);
         }
     }
+    return ctx.last_status;
 }
@@ -0,0 +1,155 @@
+#include "history.h"
+#include "log.h"
+#include <algorithm>
+#include <unistd.h>
+#include <cstdlib>
+#include <pwd.h>
+
+static const size_t default_capacity = 1000;
+static const size_t arena_bytes_per_entry = 64;
+// The log holds a few times more than the ring, so that sessions adding
+// commands at the same time compact it rarely.
+static const size_t log_bytes_per_entry = 128;
+static const size_t min_log_bytes = 1024 * 1024;
+
+static size_t env_capacity() {
+    const char* value = getenv("FUSIONSHELL_HISTSIZE");
+    if (value && *value) {
+        char* end;
+        unsigned long long n = strtoull(value, &end, 10);
+        if (*end == '\0' && n > 0) {
+            return static_cast<size_t>(n);
+        }
+    }
+    return default_capacity;
+}
+
+static std::string env_history_file() {
+    const char* value = getenv("FUSIONSHELL_HISTFILE");
+    if (value && *value) {
+        return value;
+    }
+    const char* home = getenv("HOME");
+    if (!home || !*home) {
+        struct passwd* pw = getpwuid(getuid());
+        home = pw ? pw->pw_dir : "/tmp";
+    }
+    return std::string(home) + "/.fusionshell_history";
+}
+
+History::History() : History(env_capacity(), env_history_file()) {}
+
+History::History(size_t capacity, const std::string& file)
+    : commands(capacity, capacity * arena_bytes_per_entry), current_index(0), history_file(file), loaded(false) {
+    if (history_file.empty()) {
+        loaded = true;
+        return; // memory only
+    }
+    loader = std::thread(&History::load_history, this);
+}
+
+History::~History() {
+    wait_until_loaded();
+}
+
+void History::wait_until_loaded() {
+    if (loader.joinable()) {
+        loader.join();
+    }
+}
+
+// Runs on the loader thread; nothing else touches the entries or the log
+// until it has been joined.
+void History::load_history() {
+    if (log.open(history_file, std::max(min_log_bytes, commands.capacity() * log_bytes_per_entry))) {
+        // The prefix index is built once at the end rather than kept in
+        // step with entries that are mostly evicted again.
+        log.read_new([this](std::string_view cmd) {
+            if (cmd.empty() || (!commands.empty() && commands.back() == cmd)) {
+                return;
+            }
+            commands.ensure_fits(cmd.size());
+            while (!commands.empty() && !commands.has_room(cmd.size())) {
+                commands.pop_front();
+            }
+            commands.push_back(cmd);
+        });
+        for (size_t i = 0; i < commands.size(); ++i) {
+            prefix_index.insert(commands.at(i), commands.front_seq() + i);
+        }
+        current_index = commands.size();
+    }
+    loaded.store(true, std::memory_order_release);
+}
+
+void History::evict_front() {
+    prefix_index.erase(commands.front(), commands.front_seq());
+    commands.pop_front();
+}
+
+void History::insert(std::string_view cmd) {
+    if (cmd.empty() || (!commands.empty() && commands.back() == cmd)) {
+        return;
+    }
+    commands.ensure_fits(cmd.size());
+    while (!commands.empty() && !commands.has_room(cmd.size())) {
+        evict_front();
+    }
+    commands.push_back(cmd);
+    prefix_index.insert(cmd, commands.front_seq() + commands.size() - 1);
+}
+
+void History::add_command(const std::string& cmd) {
+    wait_until_loaded();
+    if (cmd.empty() || (!commands.empty() && commands.back() == cmd)) {
+        return;
+    }
+    insert(cmd);
+    current_index = commands.size();
+    log.append(cmd);
+}
+
+bool History::sync() {
+    if (!loaded.load(std::memory_order_acquire)) {
+        return false;
+    }
+    wait_until_loaded();
+    if (!log.is_open() || log.read_new([this](std::string_view cmd) { insert(cmd); }) == 0) {
+        return false;
+    }
+    current_index = commands.size();
+    return true;
+}
+
+std::string History::get_prev_command() {
+    wait_until_loaded();
+    if (commands.empty() || current_index == 0) {
+        return "";
+    }
+    return std::string(commands.at(--current_index));
+}
+
+std::string History::get_next_command() {
+    wait_until_loaded();
+    if (current_index >= commands.size()) {
+        return "";
+    }
+    return std::string(commands.at(current_index++));
+}
+
+const HistoryRing& History::entries() {
+    wait_until_loaded();
+    return commands;
+}
+
+std::string History::get_suggestion(const std::string& prefix) {
+    if (prefix.empty()) {
+        return "";
+    }
+    wait_until_loaded();
+    uint64_t seq;
+    if (!prefix_index.find(prefix, seq) || seq < commands.front_seq()) {
+        return "";
+    }
+    return std::string(commands.at(seq - commands.front_seq()));
+}
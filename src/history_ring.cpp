@@ -0,0 +1,107 @@
+#include "history_ring.h"
+#include <algorithm>
+#include <cstring>
+
+HistoryRing::HistoryRing(size_t capacity, size_t arena_bytes)
+    : slots(new Slot[std::max<size_t>(capacity, 1)]), slot_count(std::max<size_t>(capacity, 1)),
+      arena(new char[std::max<size_t>(arena_bytes, 1) + read_padding]), arena_size(std::max<size_t>(arena_bytes, 1)),
+      head(0), count(0), write_pos(0), base_seq(0) {
+    memset(arena.get() + arena_size, 0, read_padding);
+}
+
+std::string_view HistoryRing::at(size_t i) const {
+    // i < count <= slot_count, so one conditional subtract wraps it.
+    size_t index = head + i;
+    if (index >= slot_count) {
+        index -= slot_count;
+    }
+    const Slot& slot = slots[index];
+    return std::string_view(arena.get() + slot.offset, slot.length);
+}
+
+bool HistoryRing::place(size_t len, size_t& pos) const {
+    if (count == slot_count) {
+        return false;
+    }
+    if (count == 0) {
+        pos = 0;
+        return len <= arena_size;
+    }
+    // Live text is [start, write_pos) or, once wrapped, [start, end) plus
+    // [0, write_pos). New text always goes right after the newest entry.
+    size_t start = slots[head].offset;
+    if (start < write_pos) {
+        if (write_pos + len <= arena_size) {
+            pos = write_pos;
+            return true;
+        }
+        if (len <= start) {
+            pos = 0;
+            return true;
+        }
+        return false;
+    }
+    if (write_pos + len <= start) {
+        pos = write_pos;
+        return true;
+    }
+    return false;
+}
+
+bool HistoryRing::has_room(size_t len) const {
+    size_t pos;
+    return place(len, pos);
+}
+
+void HistoryRing::grow_arena(size_t len) {
+    size_t grown_size = std::max(arena_size * 2, len * 2);
+    std::unique_ptr<char[]> grown(new char[grown_size + read_padding]);
+    memset(grown.get() + grown_size, 0, read_padding);
+    size_t offset = 0;
+    for (size_t i = 0; i < count; ++i) {
+        Slot& slot = slots[(head + i) % slot_count];
+        memcpy(grown.get() + offset, arena.get() + slot.offset, slot.length);
+        slot.offset = static_cast<uint32_t>(offset);
+        offset += slot.length;
+    }
+    arena.swap(grown);
+    arena_size = grown_size;
+    write_pos = offset;
+}
+
+void HistoryRing::ensure_fits(size_t len) {
+    if (len > arena_size) {
+        grow_arena(len);
+    }
+}
+
+void HistoryRing::push_back(std::string_view cmd) {
+    ensure_fits(cmd.size());
+    size_t pos;
+    while (!place(cmd.size(), pos)) {
+        pop_front();
+    }
+    memcpy(arena.get() + pos, cmd.data(), cmd.size());
+    slots[(head + count) % slot_count] = Slot{static_cast<uint32_t>(pos), static_cast<uint32_t>(cmd.size())};
+    count++;
+    write_pos = pos + cmd.size();
+}
+
+void HistoryRing::pop_front() {
+    if (count == 0) {
+        return;
+    }
+    head = (head + 1) % slot_count;
+    count--;
+    base_seq++;
+    if (count == 0) {
+        head = 0;
+        write_pos = 0;
+    }
+}
+
+void HistoryRing::clear() {
+    head = 0;
+    count = 0;
+    write_pos = 0;
+}
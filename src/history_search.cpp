@@ -0,0 +1,396 @@
+#include "history_search.h"
+#include "time_util.h"
+#include <algorithm>
+#include <cctype>
+#include <climits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SEARCH_X86 1
+#endif
+
+static const size_t max_query = 64;
+static const size_t short_entry = 64;
+static const size_t slice_entries = 1024;
+// Long entries can legitimately score below zero.
+static const int no_match = INT_MIN;
+
+static_assert(HistoryRing::read_padding >= short_entry, "kernels load up to 64 bytes per entry");
+
+struct Needle {
+    size_t len;
+    char lower[max_query];
+    char upper[max_query];
+};
+
+// Smart case: an uppercase letter anywhere makes the whole query exact.
+static void build_needle(std::string_view query, Needle& needle) {
+    bool fold = std::none_of(query.begin(), query.end(),
+                             [](char c) { return std::isupper(static_cast<unsigned char>(c)); });
+    needle.len = std::min(query.size(), max_query);
+    for (size_t k = 0; k < needle.len; ++k) {
+        unsigned char c = static_cast<unsigned char>(query[k]);
+        needle.lower[k] = fold ? static_cast<char>(std::tolower(c)) : static_cast<char>(c);
+        needle.upper[k] = fold ? static_cast<char>(std::toupper(c)) : static_cast<char>(c);
+    }
+}
+
+// Kernels for entries of at most 64 bytes: bit i of masks[k] is set when
+// text[i] matches query character k. They may read up to 64 bytes from
+// text (the ring's padding covers that) and mask off everything past len.
+// False as soon as some query character does not occur at all, which is
+// how most entries are rejected.
+using MaskFn = bool (*)(const char* text, size_t len, const Needle& needle, uint64_t* masks);
+
+static inline uint64_t valid_bits(size_t len) {
+    return len >= 64 ? ~0ULL : (1ULL << len) - 1;
+}
+
+static bool masks_scalar(const char* text, size_t len, const Needle& needle, uint64_t* masks) {
+    for (size_t k = 0; k < needle.len; ++k) {
+        uint64_t mask = 0;
+        for (size_t i = 0; i < len; ++i) {
+            if (text[i] == needle.lower[k] || text[i] == needle.upper[k]) {
+                mask |= 1ULL << i;
+            }
+        }
+        if (!mask) {
+            return false;
+        }
+        masks[k] = mask;
+    }
+    return true;
+}
+
+#ifdef SEARCH_X86
+__attribute__((target("sse2"))) static bool masks_sse2(const char* text, size_t len, const Needle& needle,
+                                                      uint64_t* masks) {
+    __m128i blocks[4];
+    size_t count = (len + 15) / 16;
+    for (size_t i = 0; i < count; ++i) {
+        blocks[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + 16 * i));
+    }
+    uint64_t valid = valid_bits(len);
+    for (size_t k = 0; k < needle.len; ++k) {
+        __m128i lower = _mm_set1_epi8(needle.lower[k]);
+        __m128i upper = _mm_set1_epi8(needle.upper[k]);
+        uint64_t mask = 0;
+        for (size_t i = 0; i < count; ++i) {
+            __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(blocks[i], lower), _mm_cmpeq_epi8(blocks[i], upper));
+            mask |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(hit))) << (16 * i);
+        }
+        mask &= valid;
+        if (!mask) {
+            return false;
+        }
+        masks[k] = mask;
+    }
+    return true;
+}
+
+__attribute__((target("avx2"))) static bool masks_avx2(const char* text, size_t len, const Needle& needle,
+                                                      uint64_t* masks) {
+    __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text));
+    uint64_t valid = valid_bits(len);
+    if (len <= 32) {
+        for (size_t k = 0; k < needle.len; ++k) {
+            __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(low, _mm256_set1_epi8(needle.lower[k])),
+                                          _mm256_cmpeq_epi8(low, _mm256_set1_epi8(needle.upper[k])));
+            uint64_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hit)) & valid;
+            if (!mask) {
+                return false;
+            }
+            masks[k] = mask;
+        }
+        return true;
+    }
+    __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + 32));
+    for (size_t k = 0; k < needle.len; ++k) {
+        __m256i lower = _mm256_set1_epi8(needle.lower[k]);
+        __m256i upper = _mm256_set1_epi8(needle.upper[k]);
+        __m256i hit_low = _mm256_or_si256(_mm256_cmpeq_epi8(low, lower), _mm256_cmpeq_epi8(low, upper));
+        __m256i hit_high = _mm256_or_si256(_mm256_cmpeq_epi8(high, lower), _mm256_cmpeq_epi8(high, upper));
+        uint64_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hit_low)) |
+                        static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(hit_high))) << 32;
+        mask &= valid;
+        if (!mask) {
+            return false;
+        }
+        masks[k] = mask;
+    }
+    return true;
+}
+#endif
+
+static bool kernel_chosen = false;
+static SearchKernel active_kernel = SearchKernel::Scalar;
+static MaskFn active_masks = masks_scalar;
+
+static bool kernel_available(SearchKernel kernel) {
+    switch (kernel) {
+    case SearchKernel::Scalar:
+        return true;
+#ifdef SEARCH_X86
+    case SearchKernel::SSE2:
+        return __builtin_cpu_supports("sse2");
+    case SearchKernel::AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+bool set_search_kernel(SearchKernel kernel) {
+    if (!kernel_available(kernel)) {
+        return false;
+    }
+    kernel_chosen = true;
+    active_kernel = kernel;
+    active_masks = masks_scalar;
+#ifdef SEARCH_X86
+    if (kernel == SearchKernel::SSE2) {
+        active_masks = masks_sse2;
+    } else if (kernel == SearchKernel::AVX2) {
+        active_masks = masks_avx2;
+    }
+#endif
+    return true;
+}
+
+SearchKernel search_kernel() {
+    if (!kernel_chosen) {
+        set_search_kernel(SearchKernel::AVX2) || set_search_kernel(SearchKernel::SSE2) ||
+            set_search_kernel(SearchKernel::Scalar);
+    }
+    return active_kernel;
+}
+
+const char* search_kernel_name(SearchKernel kernel) {
+    switch (kernel) {
+    case SearchKernel::Scalar:
+        return "scalar";
+    case SearchKernel::SSE2:
+        return "sse2";
+    case SearchKernel::AVX2:
+        return "avx2";
+    }
+    return "?";
+}
+
+static bool is_word_start(const char* text, size_t pos) {
+    if (pos == 0) {
+        return true;
+    }
+    switch (text[pos - 1]) {
+    case ' ':
+    case '/':
+    case '-':
+    case '_':
+    case '.':
+    case '=':
+    case '|':
+    case ';':
+        return true;
+    default:
+        return false;
+    }
+}
+
+static int score_positions(const char* text, size_t len, const uint32_t* pos, size_t count) {
+    int score = pos[0] == 0 ? 8 : 0;
+    for (size_t k = 0; k < count; ++k) {
+        score += 16;
+        if (is_word_start(text, pos[k])) {
+            score += 8;
+        }
+        if (k > 0) {
+            uint32_t gap = pos[k] - pos[k - 1] - 1;
+            score += gap == 0 ? 8 : -static_cast<int>(std::min<uint32_t>(gap, 16));
+        }
+    }
+    return score - static_cast<int>(std::min<size_t>(len, 256) / 8);
+}
+
+// Finds a substring occurrence with one AND per query character; failing
+// that, the first complete in-order match, tightened by walking back from
+// its end so the chosen positions span as little as possible.
+static int match_short(const char* text, size_t len, const Needle& needle, const uint64_t* masks) {
+    uint32_t pos[max_query];
+    uint64_t run = masks[0];
+    for (size_t k = 1; k < needle.len && run; ++k) {
+        run &= masks[k] >> k;
+    }
+    if (run) {
+        uint32_t start = __builtin_ctzll(run);
+        for (size_t k = 0; k < needle.len; ++k) {
+            pos[k] = start + k;
+        }
+        return score_positions(text, len, pos, needle.len);
+    }
+    int p = -1;
+    for (size_t k = 0; k < needle.len; ++k) {
+        uint64_t above = p >= 63 ? 0 : masks[k] & (~0ULL << (p + 1));
+        if (!above) {
+            return no_match;
+        }
+        p = __builtin_ctzll(above);
+    }
+    for (size_t k = needle.len; k-- > 0;) {
+        uint64_t below = masks[k] & (p >= 63 ? ~0ULL : (1ULL << (p + 1)) - 1);
+        p = 63 - __builtin_clzll(below);
+        pos[k] = p;
+        p--;
+    }
+    return score_positions(text, len, pos, needle.len);
+}
+
+// The same search, byte at a time, for entries too long for the kernels.
+static int match_long(const char* text, size_t len, const Needle& needle) {
+    auto hit = [&](size_t i, size_t k) { return text[i] == needle.lower[k] || text[i] == needle.upper[k]; };
+    uint32_t pos[max_query];
+    for (size_t start = 0; start + needle.len <= len; ++start) {
+        size_t k = 0;
+        while (k < needle.len && hit(start + k, k)) {
+            k++;
+        }
+        if (k == needle.len) {
+            for (k = 0; k < needle.len; ++k) {
+                pos[k] = start + k;
+            }
+            return score_positions(text, len, pos, needle.len);
+        }
+    }
+    size_t i = 0;
+    for (size_t k = 0; k < needle.len; ++k, ++i) {
+        while (i < len && !hit(i, k)) {
+            i++;
+        }
+        if (i == len) {
+            return no_match;
+        }
+    }
+    i--;
+    for (size_t k = needle.len; k-- > 0; --i) {
+        while (!hit(i, k)) {
+            i--;
+        }
+        pos[k] = i;
+    }
+    return score_positions(text, len, pos, needle.len);
+}
+
+HistorySearch::HistorySearch() : refining(false), done(true), next(0), total(0) {}
+
+void HistorySearch::reset() {
+    text.clear();
+    scanned_text.clear();
+    candidates.clear();
+    matched.clear();
+    best.clear();
+    refining = false;
+    done = true;
+    next = 0;
+    total = 0;
+}
+
+void HistorySearch::set_query(const HistoryRing& ring, std::string_view query) {
+    query = query.substr(0, max_query);
+    if (query == text) {
+        return;
+    }
+    // Every match of a longer query is a match of its prefix, so a
+    // finished scan for the prefix narrows the next one.
+    bool extends = done && !scanned_text.empty() && query.size() > scanned_text.size() &&
+                   query.compare(0, scanned_text.size(), scanned_text) == 0;
+    text.assign(query.data(), query.size());
+    best.clear();
+    next = 0;
+    if (text.empty()) {
+        candidates.clear();
+        matched.clear();
+        scanned_text.clear();
+        refining = false;
+        total = 0;
+        done = true;
+        return;
+    }
+    if (extends) {
+        candidates.swap(matched);
+        refining = true;
+        total = candidates.size();
+    } else {
+        candidates.clear();
+        refining = false;
+        total = ring.size();
+    }
+    matched.clear();
+    done = false;
+}
+
+void HistorySearch::offer(const HistoryRing& ring, uint64_t seq, int score) {
+    // Scanning runs newest first, so an equal score never displaces a
+    // held result.
+    if (best.size() == max_results && score <= best.back().score) {
+        return;
+    }
+    auto it = std::upper_bound(best.begin(), best.end(), score,
+                               [](int s, const SearchMatch& match) { return s > match.score; });
+    // An older copy of a held command scores the same, so it can only sit
+    // among the equal scores just before it.
+    std::string_view entry = ring.at(seq - ring.front_seq());
+    for (auto same = it; same != best.begin() && (same - 1)->score == score; --same) {
+        if (ring.at((same - 1)->seq - ring.front_seq()) == entry) {
+            return;
+        }
+    }
+    best.insert(it, SearchMatch{seq, score});
+    if (best.size() > max_results) {
+        best.pop_back();
+    }
+}
+
+bool HistorySearch::step(const HistoryRing& ring, uint64_t deadline_ns) {
+    if (done) {
+        return true;
+    }
+    search_kernel();
+    MaskFn build_masks = active_masks;
+    Needle needle;
+    build_needle(text, needle);
+    uint64_t masks[max_query];
+    uint64_t front = ring.front_seq();
+    size_t newest = ring.size() - 1;
+
+    while (true) {
+        size_t end = std::min(next + slice_entries, total);
+        for (; next < end; ++next) {
+            uint64_t seq = refining ? candidates[next] : front + (newest - next);
+            std::string_view entry = ring.at(seq - front);
+            if (entry.size() < needle.len) {
+                continue;
+            }
+            int score;
+            if (entry.size() <= short_entry) {
+                if (!build_masks(entry.data(), entry.size(), needle, masks)) {
+                    continue;
+                }
+                score = match_short(entry.data(), entry.size(), needle, masks);
+            } else {
+                score = match_long(entry.data(), entry.size(), needle);
+            }
+            if (score != no_match) {
+                matched.push_back(seq);
+                offer(ring, seq, score);
+            }
+        }
+        if (next == total) {
+            done = true;
+            scanned_text = text;
+            return true;
+        }
+        if (monotonic_ns() >= deadline_ns) {
+            return false;
+        }
+    }
+}
@@ -0,0 +1,136 @@
+#include "input_decoder.h"
+#include <cctype>
+#include <cstring>
+
+static const char paste_begin[] = "\033[200~";
+static const char paste_end[] = "\033[201~";
+static const size_t paste_marker_len = sizeof(paste_end) - 1;
+
+InputDecoder::InputDecoder() : consumed(0), in_paste(false) {}
+
+void InputDecoder::compact() {
+    if (consumed == pending.size()) {
+        pending.clear();
+        consumed = 0;
+    } else if (consumed > 4096) {
+        pending.erase(0, consumed);
+        consumed = 0;
+    }
+}
+
+void InputDecoder::feed(const char* data, size_t len) {
+    pending.append(data, len);
+}
+
+bool InputDecoder::has_partial() const {
+    return !in_paste && consumed < pending.size() && pending[consumed] == 27;
+}
+
+bool InputDecoder::flush_partial(Key& key) {
+    if (!has_partial()) {
+        return false;
+    }
+    consumed++;
+    compact();
+    key = Key{KeyType::Escape, 27};
+    return true;
+}
+
+bool InputDecoder::next(Key& key) {
+    while (true) {
+        size_t avail = pending.size() - consumed;
+        if (avail == 0) {
+            compact();
+            return false;
+        }
+        const char* p = pending.data() + consumed;
+
+        if (in_paste) {
+            const char* end = static_cast<const char*>(memmem(p, avail, paste_end, paste_marker_len));
+            if (!end) {
+                // Keep a possible partial end marker for the next chunk.
+                size_t safe = avail > paste_marker_len ? avail - paste_marker_len : 0;
+                paste.append(p, safe);
+                consumed += safe;
+                compact();
+                return false;
+            }
+            paste.append(p, end - p);
+            consumed += (end - p) + paste_marker_len;
+            in_paste = false;
+            compact();
+            key = Key{KeyType::Paste, 0};
+            return true;
+        }
+
+        char c = p[0];
+        if (c != 27) {
+            consumed++;
+            compact();
+            if (c == '\n' || c == '\r') {
+                key = Key{KeyType::Enter, c};
+            } else if (c == '\t') {
+                key = Key{KeyType::Tab, c};
+            } else if (c == 127 || c == '\b') {
+                key = Key{KeyType::Backspace, c};
+            } else if (c == 3) {
+                key = Key{KeyType::CtrlC, c};
+            } else if (c == 7) {
+                key = Key{KeyType::CtrlG, c};
+            } else if (c == 18) {
+                key = Key{KeyType::CtrlR, c};
+            } else if (std::isprint(static_cast<unsigned char>(c))) {
+                key = Key{KeyType::Char, c};
+            } else {
+                key = Key{KeyType::Other, c};
+            }
+            return true;
+        }
+
+        if (avail < 2) {
+            return false;
+        }
+        if (p[1] != '[' && p[1] != 'O') {
+            consumed++;
+            key = Key{KeyType::Escape, 27};
+            return true;
+        }
+
+        // CSI/SS3: parameters, then one final byte in 0x40-0x7e.
+        size_t i = 2;
+        while (i < avail && !(p[i] >= 0x40 && p[i] <= 0x7e)) {
+            i++;
+        }
+        if (i >= avail) {
+            return false;
+        }
+        size_t len = i + 1;
+        if (len == paste_marker_len && memcmp(p, paste_begin, len) == 0) {
+            consumed += len;
+            in_paste = true;
+            paste.clear();
+            continue;
+        }
+        char final_byte = p[i];
+        consumed += len;
+        compact();
+        switch (final_byte) {
+        case 'A':
+            key = Key{KeyType::Up, 0};
+            break;
+        case 'B':
+            key = Key{KeyType::Down, 0};
+            break;
+        case 'C':
+            key = Key{KeyType::Right, 0};
+            break;
+        case 'D':
+            key = Key{KeyType::Left, 0};
+            break;
+        default:
+            key = Key{KeyType::Other, 0};
+            break;
+        }
+        return true;
+    }
+}
@@ -1,91 +1,363 @@
 #include "job_control.h"
+#include "log.h"
+#include "time_util.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstdio>
 #include <iostream>
 #include <signal.h>
 #include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <cerrno>
 
-JobControl::JobControl() : next_job_id(1), shell_pgid(getpid()) {}
+static int status_code(int status) {
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    if (WIFSTOPPED(status)) {
+        return 128 + WSTOPSIG(status);
+    }
+    return 0;
+}
 
-void JobControl::add_job(pid_t pid, const std::string& command) {
-    Job job;
-    job.pid = pid;
-    job.job_id = next_job_id++;
+JobControl::JobControl(bool interactive)
+    : next_job_id(1), current_job(0), shell_pgid(getpid()), interactive(interactive) {}
+
+void JobControl::enter_subshell() {
+    jobs.clear();
+    jobs_by_pgid.clear();
+    jobs_by_pid.clear();
+    current_job = 0;
+    interactive = false;
+    notifications.clear();
+}
+
+Job& JobControl::create_job(pid_t pgid, const std::string& command, bool is_background, bool own_group) {
+    if (jobs.empty()) {
+        next_job_id = 1;
+    }
+    int job_id = next_job_id++;
+    Job& job = jobs[job_id];
+    job.job_id = job_id;
+    job.pgid = pgid;
     job.command = command;
-    job.is_background = false;
-    job.is_stopped = false;
-    jobs[pid] = job;
+    job.completed_count = 0;
+    job.stopped_count = 0;
+    job.is_background = is_background;
+    job.owns_group = interactive && own_group;
+    job.start_ns = monotonic_ns();
+    jobs_by_pgid[pgid] = job_id;
+    current_job = job_id;
+    return job;
 }
 
-void JobControl::remove_job(pid_t pid) {
-    auto it = jobs.find(pid);
-    if (it != jobs.end()) {
-        jobs.erase(it);
-    } else {
-        std::cerr << "No job found for PID " << pid << "\n";
+void JobControl::add_process(Job& job, pid_t pid, const std::string& name) {
+    Process process{};
+    process.pid = pid;
+    process.name = name;
+    process.start_ns = monotonic_ns();
+    job.processes.push_back(process);
+    jobs_by_pid[pid] = job.job_id;
+}
+
+void JobControl::remove_job(int job_id) {
+    auto it = jobs.find(job_id);
+    if (it == jobs.end()) {
+        return;
+    }
+    for (const auto& process : it->second.processes) {
+        jobs_by_pid.erase(process.pid);
+    }
+    jobs_by_pgid.erase(it->second.pgid);
+    jobs.erase(it);
+    if (current_job == job_id) {
+        current_job = 0;
+    }
+}
+
+Job* JobControl::find_job_by_id(int job_id) {
+    auto it = jobs.find(job_id);
+    return it == jobs.end() ? nullptr : &it->second;
+}
+
+Job* JobControl::find_job_by_pgid(pid_t pgid) {
+    auto it = jobs_by_pgid.find(pgid);
+    return it == jobs_by_pgid.end() ? nullptr : find_job_by_id(it->second);
+}
+
+Job* JobControl::find_current_job() {
+    if (Job* job = find_job_by_id(current_job)) {
+        return job;
     }
+    Job* newest = nullptr;
+    for (auto& pair : jobs) {
+        if (!newest || pair.first > newest->job_id) {
+            newest = &pair.second;
+        }
+    }
+    if (newest) {
+        current_job = newest->job_id;
+    }
+    return newest;
 }
 
-void JobControl::print_jobs() {
+void JobControl::print_jobs(std::string& out, bool verbose) const {
+    std::vector<int> ids;
+    ids.reserve(jobs.size());
     for (const auto& pair : jobs) {
-        const Job& job = pair.second;
-        std::cout << "[" << job.job_id << "] " << job.pid << " ";
-        if (job.is_stopped) {
-            std::cout << "Stopped ";
-        } else if (job.is_background) {
-            std::cout << "Running ";
+        ids.push_back(pair.first);
+    }
+    std::sort(ids.begin(), ids.end());
+    for (int id : ids) {
+        const Job& job = jobs.at(id);
+        out += "[" + std::to_string(job.job_id) + "]";
+        out += job.job_id == current_job ? "+  " : "   ";
+        out += job.is_stopped() ? "Stopped  " : "Running  ";
+        out += job.command;
+        out += "\n";
+        if (verbose) {
+            format_job_usage(job, out);
         }
-        std::cout << job.command << (job.is_background ? " &" : "") << "\n";
     }
 }
 
-void JobControl::set_foreground(pid_t pid) {
-    auto it = jobs.find(pid);
-    if (it != jobs.end()) {
-        Job& job = it->second;
-        job.is_background = false;
-        job.is_stopped = false;
-        tcsetpgrp(STDIN_FILENO, pid);
-        std::cout << "Setting terminal to PID " << pid << "\n";
-        kill(-pid, SIGCONT);
+bool JobControl::update_process(pid_t pid, int status, const struct rusage& usage, Job*& job) {
+    auto it = jobs_by_pid.find(pid);
+    if (it == jobs_by_pid.end()) {
+        return false;
     }
+    job = find_job_by_id(it->second);
+    for (auto& process : job->processes) {
+        if (process.pid != pid) {
+            continue;
+        }
+        if (WIFSTOPPED(status)) {
+            trace_instant("stopped", pid, process.name);
+            if (!process.stopped) {
+                process.stopped = true;
+                job->stopped_count++;
+            }
+        } else if (WIFCONTINUED(status)) {
+            if (process.stopped) {
+                process.stopped = false;
+                job->stopped_count--;
+            }
+        } else if (!process.completed) {
+            if (process.stopped) {
+                process.stopped = false;
+                job->stopped_count--;
+            }
+            process.completed = true;
+            process.status = status;
+            process.end_ns = monotonic_ns();
+            process.usage = usage;
+            trace_span("process", process.start_ns, process.end_ns, pid, process.name);
+            job->completed_count++;
+        }
+        break;
+    }
+    return true;
 }
 
-void JobControl::handle_child_signal(pid_t pid, int status) {
-    auto it = jobs.find(pid);
-    if (it == jobs.end()) {
+int JobControl::wait_for_job(Job& job, bool resume, Job* finished) {
+    uint64_t wait_start = tracing() ? monotonic_ns() : 0;
+    job.is_background = false;
+    if (interactive && job.owns_group) {
+        tcsetpgrp(STDIN_FILENO, job.pgid);
+        LOG_DEBUGF("terminal handed to job %d (pgid %d)", job.job_id, job.pgid);
+        trace_instant("tcsetpgrp", job.pgid, "to job");
+    }
+    if (resume && job.stopped_count > 0) {
+        for (auto& process : job.processes) {
+            process.stopped = false;
+        }
+        job.stopped_count = 0;
+        kill(job.owns_group ? -job.pgid : job.processes.front().pid, SIGCONT);
+    }
+
+    while (!job.is_completed() && !job.is_stopped()) {
+        pid_t target = job.pgid;
+        if (job.owns_group) {
+            target = -job.pgid;
+        } else {
+            for (const auto& process : job.processes) {
+                if (!process.completed && !process.stopped) {
+                    target = process.pid;
+                    break;
+                }
+            }
+        }
+        int status;
+        struct rusage usage;
+        pid_t pid = wait4(target, &status, WUNTRACED, &usage);
+        if (pid == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        Job* owner;
+        update_process(pid, status, usage, owner);
+    }
+
+    if (tracing()) {
+        trace_span("wait", wait_start, monotonic_ns(), 0, job.command);
+    }
+
+    int result = 0;
+    const Process& last = job.processes.back();
+    if (last.completed) {
+        result = status_code(last.status);
+    } else if (job.is_stopped()) {
+        result = 128 + SIGTSTP;
+    }
+
+    if (job.is_completed()) {
+        if (finished) {
+            *finished = job;
+        }
+        remove_job(job.job_id);
+    } else if (job.is_stopped()) {
+        current_job = job.job_id;
+        std::cout << "\n[" << job.job_id << "]+  Stopped  " << job.command << "\n";
+    }
+    return result;
+}
+
+void JobControl::continue_in_background(Job& job) {
+    job.is_background = true;
+    for (auto& process : job.processes) {
+        process.stopped = false;
+    }
+    job.stopped_count = 0;
+    kill(job.owns_group ? -job.pgid : job.processes.front().pid, SIGCONT);
+}
+
+void JobControl::handle_child_signal(pid_t pid, int status, const struct rusage& usage) {
+    Job* job;
+    bool was_stopped = false;
+    auto it = jobs_by_pid.find(pid);
+    if (it != jobs_by_pid.end()) {
+        was_stopped = find_job_by_id(it->second)->is_stopped();
+    }
+    if (!update_process(pid, status, usage, job)) {
+        LOG_DEBUGF("reaped unknown child %d, status 0x%x", pid, status);
         return;
     }
+    LOG_DEBUGF("child %d of job %d changed state, status 0x%x", pid, job->job_id, status);
 
-    Job& job = it->second;
-    std::cout << "SIGCHLD PID " << pid << " stopped: " << WIFSTOPPED(status)
-              << " exited: " << WIFEXITED(status)
-              << " signaled: " << WIFSIGNALED(status)
-              << " continued: " << WIFCONTINUED(status) << "\n";
+    std::string message;
+    if (job->is_completed()) {
+        int last = job->processes.back().status;
+        if (WIFSIGNALED(last)) {
+            message = "Terminated by signal " + std::to_string(WTERMSIG(last));
+        } else if (WEXITSTATUS(last) != 0) {
+            message = "Exit " + std::to_string(WEXITSTATUS(last));
+        } else {
+            message = "Done";
+        }
+    } else if (job->is_stopped() && !was_stopped) {
+        message = "Stopped";
+    } else if (WIFCONTINUED(status) && was_stopped) {
+        message = "Continued";
+    }
+    if (interactive && job->owns_group && !message.empty()) {
+        notifications += "[" + std::to_string(job->job_id) + "] " + message + "  " + job->command + "\n";
+    }
+    if (job->is_completed()) {
+        remove_job(job->job_id);
+    }
+}
 
-    if (WIFEXITED(status)) {
-        std::cout << "Job exited with status " << WEXITSTATUS(status) << "\n";
-        remove_job(pid);
-    } else if (WIFSIGNALED(status)) {
-        std::cout << "Job terminated by signal " << WTERMSIG(status) << "\n";
-        remove_job(pid);
-    } else if (WIFSTOPPED(status)) {
-        job.is_stopped = true;
-        std::cout << "[" << job.job_id << "] Stopped " << job.command << "\n";
-    } else if (WIFCONTINUED(status)) {
-        job.is_stopped = false;
-        std::cout << "[" << job.job_id << "] Continued " << job.command << "\n";
+void JobControl::reap_children() {
+    pid_t pid;
+    int status;
+    struct rusage usage;
+    while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage)) > 0) {
+        handle_child_signal(pid, status, usage);
     }
 }
 
-Job* JobControl::find_job_by_id(int job_id) {
-    for (auto& pair : jobs) {
-        if (pair.second.job_id == job_id) {
-            return &pair.second;
+void JobControl::reap_jobs() {
+    std::vector<pid_t> pids;
+    pids.reserve(jobs_by_pid.size());
+    for (const auto& pair : jobs_by_pid) {
+        pids.push_back(pair.first);
+    }
+    int status;
+    struct rusage usage;
+    for (pid_t pid : pids) {
+        if (wait4(pid, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage) == pid) {
+            handle_child_signal(pid, status, usage);
         }
     }
-    return nullptr;
+}
+
+std::string JobControl::take_notifications() {
+    std::string pending;
+    pending.swap(notifications);
+    return pending;
 }
 
 void JobControl::restore_terminal_control() {
+    if (!interactive) {
+        return;
+    }
     tcsetpgrp(STDIN_FILENO, shell_pgid);
-    std::cout << "Restoring terminal to shell PGID " << shell_pgid << "\n";
+    trace_instant("tcsetpgrp", 0, "to shell");
+    LOG_DEBUGF("terminal returned to shell pgid %d", shell_pgid);
+}
+
+static double timeval_seconds(const struct timeval& tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void append_usage_line(std::string& out, const char* label, double real, const struct rusage* usage,
+                              const std::string& name) {
+    char line[256];
+    if (usage) {
+        snprintf(line, sizeof(line), "  %-8s real %9.6fs  user %9.6fs  sys %9.6fs  maxrss %7ldK  csw %ld/%ld  flt %ld/%ld",
+                 label, real, timeval_seconds(usage->ru_utime), timeval_seconds(usage->ru_stime), usage->ru_maxrss,
+                 usage->ru_nvcsw, usage->ru_nivcsw, usage->ru_minflt, usage->ru_majflt);
+    } else {
+        snprintf(line, sizeof(line), "  %-8s real %9.6fs", label, real);
+    }
+    out += line;
+    if (!name.empty()) {
+        out += "  " + name;
+    }
+    out += '\n';
+}
+
+void format_job_usage(const Job& job, std::string& out) {
+    uint64_t now = monotonic_ns();
+    uint64_t job_end = job.start_ns;
+    struct rusage total{};
+    bool all_done = true;
+    for (const auto& process : job.processes) {
+        uint64_t end = process.completed ? process.end_ns : now;
+        job_end = std::max(job_end, end);
+        std::string label = std::to_string(process.pid);
+        if (!process.completed) {
+            all_done = false;
+            append_usage_line(out, label.c_str(), (end - process.start_ns) / 1e9, nullptr, process.name);
+            continue;
+        }
+        const struct rusage& u = process.usage;
+        append_usage_line(out, label.c_str(), (end - process.start_ns) / 1e9, &u, process.name);
+        timeradd(&total.ru_utime, &u.ru_utime, &total.ru_utime);
+        timeradd(&total.ru_stime, &u.ru_stime, &total.ru_stime);
+        total.ru_maxrss = std::max(total.ru_maxrss, u.ru_maxrss);
+        total.ru_nvcsw += u.ru_nvcsw;
+        total.ru_nivcsw += u.ru_nivcsw;
+        total.ru_minflt += u.ru_minflt;
+        total.ru_majflt += u.ru_majflt;
+    }
+    if (all_done && job.processes.size() > 1) {
+        append_usage_line(out, "total", (job_end - job.start_ns) / 1e9, &total, "");
+    }
 }
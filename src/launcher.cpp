@@ -0,0 +1,142 @@
+#include "launcher.h"
+#include "trace.h"
+#include <iostream>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+extern char** environ;
+
+// The shell ignores these for itself; children must start with defaults.
+static const int reset_signals[] = {SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU, SIGCHLD};
+
+static int spawn_process(const LaunchSpec& spec, pid_t& pid) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    int err = posix_spawn_file_actions_init(&actions);
+    if (err != 0) {
+        return err;
+    }
+    err = posix_spawnattr_init(&attr);
+    if (err != 0) {
+        posix_spawn_file_actions_destroy(&actions);
+        return err;
+    }
+
+    if (spec.stdin_fd != STDIN_FILENO) {
+        posix_spawn_file_actions_adddup2(&actions, spec.stdin_fd, STDIN_FILENO);
+    }
+    if (spec.stdout_fd != STDOUT_FILENO) {
+        posix_spawn_file_actions_adddup2(&actions, spec.stdout_fd, STDOUT_FILENO);
+    }
+    if (spec.stderr_fd != STDERR_FILENO) {
+        posix_spawn_file_actions_adddup2(&actions, spec.stderr_fd, STDERR_FILENO);
+    }
+
+    sigset_t defaults;
+    sigemptyset(&defaults);
+    for (int sig : reset_signals) {
+        sigaddset(&defaults, sig);
+    }
+    sigset_t mask;
+    sigemptyset(&mask);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+    if (spec.pgid >= 0) {
+        posix_spawnattr_setpgroup(&attr, spec.pgid);
+        flags |= POSIX_SPAWN_SETPGROUP;
+    }
+    posix_spawnattr_setflags(&attr, flags);
+
+    err = posix_spawn(&pid, spec.path, &actions, &attr, spec.argv, environ);
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    return err;
+}
+
+// The child's side of a launch: its group, default signals and standard
+// descriptors.
+static void enter_stage(const LaunchSpec& spec) {
+    if (spec.pgid >= 0) {
+        setpgid(0, spec.pgid);
+    }
+    for (int sig : reset_signals) {
+        signal(sig, SIG_DFL);
+    }
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, nullptr);
+
+    if (spec.stdin_fd != STDIN_FILENO) {
+        dup2(spec.stdin_fd, STDIN_FILENO);
+    }
+    if (spec.stdout_fd != STDOUT_FILENO) {
+        dup2(spec.stdout_fd, STDOUT_FILENO);
+    }
+    if (spec.stderr_fd != STDERR_FILENO) {
+        dup2(spec.stderr_fd, STDERR_FILENO);
+    }
+}
+
+static pid_t fork_process(const LaunchSpec& spec) {
+    std::cout.flush();
+    std::cerr.flush();
+    pid_t pid = fork();
+    if (pid == -1) {
+        return -1;
+    }
+
+    if (pid == 0) {
+        enter_stage(spec);
+        if (spec.body) {
+            int status = spec.body();
+            std::cout.flush();
+            _exit(status);
+        }
+        execvp(spec.path, spec.argv);
+        std::cerr << "execvp failed: " << strerror(errno) << "\n";
+        _exit(127);
+    }
+
+    // Set the group from both sides so neither the exec nor a following
+    // tcsetpgrp can race the child.
+    if (spec.pgid >= 0) {
+        setpgid(pid, spec.pgid == 0 ? pid : spec.pgid);
+    }
+    return pid;
+}
+
+pid_t launch_process(const LaunchSpec& spec) {
+    if (spec.body) {
+        return fork_process(spec);
+    }
+    pid_t pid = -1;
+    int err = spawn_process(spec, pid);
+    if (err == 0) {
+        // glibc's posix_spawn only returns once the child has exec'd.
+        trace_instant("exec", pid, spec.path);
+        return pid;
+    }
+
+    // ENOEXEC: execvp's /bin/sh fallback for scripts without a #! line.
+    // ENOSYS/EINVAL: the libc cannot honour one of the spawn attributes.
+    if (err == ENOEXEC || err == ENOSYS || err == EINVAL) {
+        return fork_process(spec);
+    }
+
+    errno = err;
+    return -1;
+}
+
+int exec_process(const LaunchSpec& spec) {
+    std::cout.flush();
+    std::cerr.flush();
+    enter_stage(spec);
+    trace_instant("exec", getpid(), spec.path);
+    execvp(spec.path, spec.argv);
+    return -1;
+}
@@ -0,0 +1,164 @@
+#include "lexer.h"
+#include <algorithm>
+#include <cctype>
+
+static const uint8_t have_command = 1;
+static const uint8_t expect_file = 2;
+
+// Index just past the ')' closing a "$(" that ends before pos, or the end
+// of the line while it is still open. Nested parentheses and quotes are
+// skipped the way parse_command skips them.
+static size_t substitution_end(const std::string& line, size_t pos) {
+    int depth = 1;
+    while (pos < line.size()) {
+        char c = line[pos++];
+        if (c == '\\') {
+            pos = std::min(pos + 1, line.size());
+        } else if (c == '\'' || c == '"') {
+            while (pos < line.size() && line[pos] != c) {
+                if (c == '"' && line[pos] == '\\') {
+                    pos++;
+                }
+                pos++;
+            }
+            pos = std::min(pos + 1, line.size());
+        } else if (c == '(') {
+            depth++;
+        } else if (c == ')' && --depth == 0) {
+            return pos;
+        }
+    }
+    return line.size();
+}
+
+bool IncrementalLexer::lex_one(const std::string& line, size_t& pos, uint8_t& state, LexToken& token) {
+    while (pos < line.size() && std::isspace(static_cast<unsigned char>(line[pos]))) {
+        pos++;
+    }
+    if (pos >= line.size()) {
+        return false;
+    }
+
+    token.start = pos;
+    token.state_before = state;
+    char c = line[pos];
+    if (c == '|' || c == '>' || c == '<' || c == '&' || c == ';' || c == '(' || c == ')') {
+        pos++;
+        token.cls = TokenClass::Operator;
+        if (c == '>' || c == '<') {
+            state |= expect_file;
+        } else if (c == ')') {
+            state = have_command; // only redirections may follow
+        } else {
+            state = 0; // a command comes next
+        }
+    } else {
+        while (pos < line.size()) {
+            char w = line[pos];
+            if (w == '$' && pos + 1 < line.size() && line[pos + 1] == '(') {
+                pos = substitution_end(line, pos + 2);
+                continue;
+            }
+            if (std::isspace(static_cast<unsigned char>(w)) || w == '|' || w == '>' || w == '<' || w == '&' ||
+                w == ';' || w == '(' || w == ')') {
+                break;
+            }
+            pos++;
+            if (w == '\\') {
+                pos = std::min(pos + 1, line.size());
+            } else if (w == '\'' || w == '"') {
+                // An open quote runs to the end of the line.
+                while (pos < line.size() && line[pos] != w) {
+                    if (w == '"' && line[pos] == '\\') {
+                        pos++;
+                    }
+                    pos++;
+                }
+                pos = std::min(pos + 1, line.size());
+            }
+        }
+        if (state & expect_file) {
+            token.cls = TokenClass::File;
+            state &= ~expect_file;
+        } else if (!(state & have_command)) {
+            token.cls = TokenClass::Command;
+            state |= have_command;
+        } else {
+            token.cls = TokenClass::Argument;
+        }
+    }
+    token.end = pos;
+    token.state_after = state;
+    return true;
+}
+
+TokenClass IncrementalLexer::class_at(size_t pos) const {
+    uint8_t state = 0;
+    for (const auto& token : tokens) {
+        if (token.start >= pos) {
+            break;
+        }
+        state = token.state_after;
+    }
+    if (state & expect_file) {
+        return TokenClass::File;
+    }
+    return state & have_command ? TokenClass::Argument : TokenClass::Command;
+}
+
+void IncrementalLexer::reset(const std::string& line) {
+    tokens.clear();
+    size_t pos = 0;
+    uint8_t state = 0;
+    LexToken token;
+    while (lex_one(line, pos, state, token)) {
+        tokens.push_back(token);
+    }
+}
+
+void IncrementalLexer::update(const std::string& line, size_t start, size_t old_len, size_t new_len) {
+    // First token that ends at or after the edit; anything before it is
+    // untouched. A token ending exactly at the edit may grow into it.
+    size_t first = 0;
+    while (first < tokens.size() && tokens[first].end < start) {
+        first++;
+    }
+    size_t pos = first > 0 ? tokens[first - 1].end : 0;
+    uint8_t state = first > 0 ? tokens[first - 1].state_after : 0;
+
+    size_t old_edit_end = start + old_len;
+    size_t new_edit_end = start + new_len;
+    long delta = static_cast<long>(new_len) - static_cast<long>(old_len);
+
+    scratch.clear();
+    size_t old = first;
+    size_t resume = tokens.size();
+    LexToken token;
+    while (lex_one(line, pos, state, token)) {
+        scratch.push_back(token);
+        if (token.start < new_edit_end) {
+            continue;
+        }
+        // Past the edit: stop as soon as an old token starts at the same
+        // shifted place in the same state.
+        while (old < tokens.size() && (tokens[old].start < old_edit_end ||
+                                       static_cast<long>(tokens[old].start) + delta < static_cast<long>(token.start))) {
+            old++;
+        }
+        if (old < tokens.size() && static_cast<long>(tokens[old].start) + delta == static_cast<long>(token.start) &&
+            tokens[old].state_before == token.state_before) {
+            scratch.pop_back();
+            resume = old;
+            break;
+        }
+    }
+
+    for (size_t i = resume; i < tokens.size(); ++i) {
+        LexToken shifted = tokens[i];
+        shifted.start += delta;
+        shifted.end += delta;
+        scratch.push_back(shifted);
+    }
+    tokens.resize(first);
+    tokens.insert(tokens.end(), scratch.begin(), scratch.end());
+}
@@ -0,0 +1,119 @@
+#include "line_renderer.h"
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+
+enum : uint8_t {
+    COLOR_NONE,
+    COLOR_COMMAND,
+    COLOR_ARG,
+    COLOR_OP,
+    COLOR_FILE,
+    COLOR_SUGGEST,
+};
+
+static const char* const color_codes[] = {
+    "\033[0m",  // reset
+    "\033[32m", // green
+    "\033[33m", // yellow
+    "\033[31m", // red
+    "\033[34m", // blue
+    "\033[90m", // gray
+};
+
+static uint8_t color_for(TokenClass cls) {
+    switch (cls) {
+    case TokenClass::Command:
+        return COLOR_COMMAND;
+    case TokenClass::Argument:
+        return COLOR_ARG;
+    case TokenClass::Operator:
+        return COLOR_OP;
+    case TokenClass::File:
+        return COLOR_FILE;
+    }
+    return COLOR_NONE;
+}
+
+LineRenderer::LineRenderer(int out_fd) : fd(out_fd) {}
+
+void LineRenderer::reset() {
+    painted.clear();
+}
+
+void LineRenderer::append_color(uint8_t color) {
+    frame += color_codes[color];
+}
+
+void LineRenderer::flush_frame() {
+    const char* data = frame.data();
+    size_t len = frame.size();
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        data += n;
+        len -= n;
+    }
+    frame.clear();
+}
+
+void LineRenderer::write_raw(std::string_view text) {
+    frame.assign(text.data(), text.size());
+    flush_frame();
+    painted.clear();
+}
+
+void LineRenderer::render(std::string_view prompt, const std::string& line, const std::vector<LexToken>& tokens,
+                          std::string_view suggestion, size_t cursor) {
+    next.clear();
+    for (char c : prompt) {
+        next.push_back(Cell{c, COLOR_NONE});
+    }
+    size_t line_start = next.size();
+    for (char c : line) {
+        next.push_back(Cell{c, COLOR_NONE});
+    }
+    for (const auto& token : tokens) {
+        uint8_t color = color_for(token.cls);
+        for (size_t i = token.start; i < token.end; ++i) {
+            next[line_start + i].color = color;
+        }
+    }
+    for (char c : suggestion) {
+        next.push_back(Cell{c, COLOR_SUGGEST});
+    }
+
+    size_t first_diff = 0;
+    size_t common = std::min(painted.size(), next.size());
+    while (first_diff < common && !(painted[first_diff] != next[first_diff])) {
+        first_diff++;
+    }
+
+    frame.clear();
+    if (first_diff < next.size() || painted.size() > next.size()) {
+        frame += "\r";
+        if (first_diff > 0) {
+            frame += "\033[" + std::to_string(first_diff) + "C";
+        }
+        uint8_t current = COLOR_NONE;
+        for (size_t i = first_diff; i < next.size(); ++i) {
+            if (next[i].color != current) {
+                append_color(next[i].color);
+                current = next[i].color;
+            }
+            frame += next[i].ch;
+        }
+        if (current != COLOR_NONE) {
+            append_color(COLOR_NONE);
+        }
+        if (painted.size() > next.size()) {
+            frame += "\033[K";
+        }
+    }
+    frame += "\033[" + std::to_string(line_start + cursor + 1) + "G";
+    flush_frame();
+    painted.swap(next);
+}
@@ -0,0 +1,183 @@
+#include "log.h"
+#include "io_util.h"
+#include "time_util.h"
+#include <atomic>
+#include <cstdarg>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t ring_capacity = 1024; // power of two
+const size_t message_bytes = 200;
+const uint64_t slot_busy = UINT64_MAX;
+
+struct LogRecord {
+    // Sequence number + 1 once the record is fully written; a reader
+    // that sees anything else skips or waits for it. Writers and the
+    // flusher claim a slot by swapping in slot_busy, and a writer that
+    // finds it claimed (lapped, or mid-flush) drops its message.
+    std::atomic<uint64_t> committed;
+    uint64_t time_ns;
+    LogLevel level;
+    uint16_t length;
+    char message[message_bytes];
+};
+
+LogRecord ring[ring_capacity];
+std::atomic<uint64_t> write_seq{0};
+uint64_t read_seq = 0;
+int log_fd = STDERR_FILENO;
+
+const char* const level_names[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+
+// Appends to a fixed buffer, silently truncating.
+struct Writer {
+    char* data;
+    size_t capacity;
+    size_t length = 0;
+
+    void put(char c) {
+        if (length < capacity) {
+            data[length++] = c;
+        }
+    }
+    void put(const char* text) {
+        while (*text) {
+            put(*text++);
+        }
+    }
+    void put_unsigned(unsigned long value, unsigned base, size_t min_digits = 1) {
+        char digits[24];
+        size_t n = 0;
+        do {
+            digits[n++] = "0123456789abcdef"[value % base];
+            value /= base;
+        } while (value != 0);
+        while (n < min_digits) {
+            digits[n++] = '0';
+        }
+        while (n > 0) {
+            put(digits[--n]);
+        }
+    }
+    void put_signed(long value) {
+        if (value < 0) {
+            put('-');
+            put_unsigned(0ul - static_cast<unsigned long>(value), 10);
+        } else {
+            put_unsigned(static_cast<unsigned long>(value), 10);
+        }
+    }
+};
+
+void format(Writer& out, const char* format, va_list args) {
+    for (const char* p = format; *p; ++p) {
+        if (*p != '%') {
+            out.put(*p);
+            continue;
+        }
+        ++p;
+        if (*p == 's') {
+            const char* text = va_arg(args, const char*);
+            out.put(text ? text : "(null)");
+        } else if (*p == 'd') {
+            out.put_signed(va_arg(args, int));
+        } else if (*p == 'u') {
+            out.put_unsigned(va_arg(args, unsigned), 10);
+        } else if (*p == 'x') {
+            out.put_unsigned(va_arg(args, unsigned), 16);
+        } else if (*p == 'l' && p[1] == 'd') {
+            out.put_signed(va_arg(args, long));
+            ++p;
+        } else if (*p == 'l' && p[1] == 'u') {
+            out.put_unsigned(va_arg(args, unsigned long), 10);
+            ++p;
+        } else if (*p == 'z' && p[1] == 'u') {
+            out.put_unsigned(va_arg(args, size_t), 10);
+            ++p;
+        } else if (*p == '%') {
+            out.put('%');
+        } else {
+            return; // unsupported conversion: stop rather than misread args
+        }
+    }
+}
+
+LogLevel parse_level(const char* name) {
+    for (int level = LOG_DEBUG; level < LOG_OFF; ++level) {
+        if (strcasecmp(name, level_names[level]) == 0) {
+            return static_cast<LogLevel>(level);
+        }
+    }
+    return LOG_OFF;
+}
+
+} // namespace
+
+int log_threshold = LOG_OFF;
+
+void log_init() {
+    const char* level = getenv("FUSIONSHELL_LOG");
+    if (!level || !*level) {
+        return;
+    }
+    const char* file = getenv("FUSIONSHELL_LOG_FILE");
+    if (file && *file) {
+        int fd = open(file, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+        if (fd == -1) {
+            return;
+        }
+        log_fd = fd;
+    }
+    log_threshold = parse_level(level);
+}
+
+void log_write(LogLevel level, const char* fmt, ...) {
+    uint64_t seq = write_seq.fetch_add(1, std::memory_order_relaxed);
+    LogRecord& record = ring[seq & (ring_capacity - 1)];
+    uint64_t seen = record.committed.load(std::memory_order_relaxed);
+    if (seen == slot_busy ||
+        !record.committed.compare_exchange_strong(seen, slot_busy, std::memory_order_acquire)) {
+        return;
+    }
+    record.time_ns = monotonic_ns();
+    record.level = level;
+    Writer out{record.message, message_bytes};
+    va_list args;
+    va_start(args, fmt);
+    format(out, fmt, args);
+    va_end(args);
+    record.length = static_cast<uint16_t>(out.length);
+    record.committed.store(seq + 1, std::memory_order_release);
+}
+
+void log_flush() {
+    uint64_t end = write_seq.load(std::memory_order_acquire);
+    if (end - read_seq > ring_capacity) {
+        read_seq = end - ring_capacity; // overwritten before we got to them
+    }
+    char line[message_bytes + 48];
+    for (; read_seq < end; ++read_seq) {
+        LogRecord& record = ring[read_seq & (ring_capacity - 1)];
+        uint64_t expected = read_seq + 1;
+        if (!record.committed.compare_exchange_strong(expected, slot_busy, std::memory_order_acquire)) {
+            break; // still being written, or already reused
+        }
+        Writer out{line, sizeof(line)};
+        out.put_unsigned(record.time_ns / 1000000000ull, 10);
+        out.put('.');
+        out.put_unsigned(record.time_ns / 1000 % 1000000, 10, 6);
+        out.put(' ');
+        out.put(level_names[record.level]);
+        out.put(' ');
+        for (size_t i = 0; i < record.length; ++i) {
+            out.put(record.message[i]);
+        }
+        out.put('\n');
+        record.committed.store(read_seq + 1, std::memory_order_release);
+        write_all(log_fd, line, out.length);
+    }
+}
@@ -1,7 +1,31 @@
 #include "fusionshell.h"
+#include "log.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+int main(int argc, char* argv[]) {
+    log_init();
+    if (argc > 2 && std::string(argv[1]) == "-c") {
+        FusionShell shell(false);
+        std::istringstream script(argv[2]);
+        return shell.run_script(script, true);
+    }
+    if (argc > 1) {
+        std::ifstream script(argv[1]);
+        if (!script.is_open()) {
+            std::cerr << "fusionshell: " << argv[1] << ": cannot open script\n";
+            return 127;
+        }
+        FusionShell shell(false);
+        return shell.run_script(script);
+    }
+    if (!isatty(STDIN_FILENO)) {
+        FusionShell shell(false);
+        return shell.run_script_fd(STDIN_FILENO);
+    }
 
-int main() {
     FusionShell shell;
-    shell.run();
-    return 0;
+    return shell.run();
 }
@@ -0,0 +1,270 @@
+#include "parallel.h"
+#include "io_util.h"
+#include "launcher.h"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+// One worker's share of the inputs. The owner pops from the front;
+// thieves take from the back so they rarely touch the same end.
+struct WorkQueue {
+    std::mutex lock;
+    std::deque<size_t> items;
+};
+
+struct Batch {
+    std::vector<std::string_view> command;
+    std::vector<std::string> inputs;
+    bool keep_order = false;
+    int stdin_fd = STDIN_FILENO;
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+
+    std::mutex hash_lock;
+    CommandHash* command_hash = nullptr;
+
+    std::mutex output_lock;
+    std::vector<std::string> results; // -k: finished output awaiting its turn
+    std::vector<bool> finished;
+    size_t next_to_flush = 0;
+
+    std::atomic<int> failures{0};
+};
+
+bool take_work(Batch& batch, size_t self, size_t& item) {
+    {
+        WorkQueue& own = *batch.queues[self];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.items.empty()) {
+            item = own.items.front();
+            own.items.pop_front();
+            return true;
+        }
+    }
+    for (size_t step = 1; step < batch.queues.size(); ++step) {
+        WorkQueue& victim = *batch.queues[(self + step) % batch.queues.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.items.empty()) {
+            item = victim.items.back();
+            victim.items.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<std::string> expand(const Batch& batch, const std::string& input) {
+    std::vector<std::string> words;
+    bool substituted = false;
+    for (std::string_view token : batch.command) {
+        std::string word;
+        size_t pos = 0;
+        size_t hole;
+        while ((hole = token.find("{}", pos)) != std::string_view::npos) {
+            word.append(token.substr(pos, hole - pos));
+            word += input;
+            pos = hole + 2;
+            substituted = true;
+        }
+        word.append(token.substr(pos));
+        words.push_back(std::move(word));
+    }
+    if (!substituted) {
+        words.push_back(input);
+    }
+    return words;
+}
+
+void emit(Batch& batch, size_t item, std::string output) {
+    std::lock_guard<std::mutex> guard(batch.output_lock);
+    if (!batch.keep_order) {
+        write_all(STDOUT_FILENO, output);
+        return;
+    }
+    batch.results[item] = std::move(output);
+    batch.finished[item] = true;
+    while (batch.next_to_flush < batch.inputs.size() && batch.finished[batch.next_to_flush]) {
+        std::string& ready = batch.results[batch.next_to_flush];
+        write_all(STDOUT_FILENO, ready);
+        std::string().swap(ready);
+        batch.next_to_flush++;
+    }
+}
+
+// Runs one input to completion; returns its output, or sets failed.
+std::string run_one(Batch& batch, size_t item, bool& failed) {
+    std::vector<std::string> words = expand(batch, batch.inputs[item]);
+    std::string output;
+    failed = true;
+
+    std::string path;
+    {
+        std::lock_guard<std::mutex> guard(batch.hash_lock);
+        path = batch.command_hash->lookup(words[0]);
+    }
+    if (path.empty()) {
+        write_all(STDERR_FILENO, "parallel: " + words[0] + ": command not found\n");
+        return output;
+    }
+
+    std::vector<char*> argv;
+    for (auto& word : words) {
+        argv.push_back(&word[0]);
+    }
+    argv.push_back(nullptr);
+
+    int pipefd[2];
+    if (pipe2(pipefd, O_CLOEXEC) == -1) {
+        write_all(STDERR_FILENO, std::string("parallel: ") + strerror(errno) + "\n");
+        return output;
+    }
+    LaunchSpec spec{path.c_str(), argv.data(), batch.stdin_fd, pipefd[1], STDERR_FILENO, -1, nullptr};
+    pid_t pid = launch_process(spec);
+    int launch_errno = errno;
+    close(pipefd[1]);
+    if (pid == -1) {
+        close(pipefd[0]);
+        write_all(STDERR_FILENO, "parallel: " + words[0] + ": " + strerror(launch_errno) + "\n");
+        return output;
+    }
+
+    char buffer[65536];
+    while (true) {
+        ssize_t n = read(pipefd[0], buffer, sizeof(buffer));
+        if (n > 0) {
+            output.append(buffer, n);
+        } else if (n == 0 || errno != EINTR) {
+            break;
+        }
+    }
+    close(pipefd[0]);
+
+    int status;
+    while (waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR) {
+            return output;
+        }
+    }
+    failed = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    return output;
+}
+
+void worker(Batch& batch, size_t self) {
+    size_t item;
+    while (take_work(batch, self, item)) {
+        bool failed;
+        std::string output = run_one(batch, item, failed);
+        if (failed) {
+            batch.failures++;
+        }
+        emit(batch, item, std::move(output));
+    }
+}
+
+bool read_lines(int fd, std::vector<std::string>& lines) {
+    std::string data;
+    char buffer[65536];
+    while (true) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            data.append(buffer, n);
+        } else if (n == 0) {
+            break;
+        } else if (errno != EINTR) {
+            return false;
+        }
+    }
+    size_t start = 0;
+    while (start < data.size()) {
+        size_t end = data.find('\n', start);
+        if (end == std::string::npos) {
+            end = data.size();
+        }
+        if (end > start) {
+            lines.emplace_back(data, start, end - start);
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+} // namespace
+
+int builtin_parallel(ShellContext& ctx, const std::vector<std::string_view>& args, BuiltinIO& io) {
+    Batch batch;
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t i = 1;
+    for (; i < args.size() && args[i].size() > 1 && args[i][0] == '-'; ++i) {
+        if (args[i] == "-k") {
+            batch.keep_order = true;
+        } else if (args[i] == "-j" && i + 1 < args.size()) {
+            std::string count(args[++i]);
+            char* end;
+            jobs = strtol(count.c_str(), &end, 10);
+            if (*end != '\0' || jobs <= 0) {
+                io.err += "parallel: " + count + ": invalid job count\n";
+                return 2;
+            }
+        } else {
+            break;
+        }
+    }
+    for (; i < args.size() && args[i] != ":::"; ++i) {
+        batch.command.push_back(args[i]);
+    }
+    if (batch.command.empty()) {
+        io.err += "parallel: usage: parallel [-j jobs] [-k] command [args...] [::: inputs...]\n";
+        return 2;
+    }
+    if (i < args.size()) {
+        for (++i; i < args.size(); ++i) {
+            batch.inputs.emplace_back(args[i]);
+        }
+    } else {
+        if (!read_lines(io.in_fd, batch.inputs)) {
+            io.err += std::string("parallel: ") + strerror(errno) + "\n";
+            return 1;
+        }
+        // stdin is spent; children must not race for what is left of it.
+        batch.stdin_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+    if (batch.inputs.empty()) {
+        return 0;
+    }
+
+    size_t workers = std::min(static_cast<size_t>(jobs > 0 ? jobs : 1), batch.inputs.size());
+    for (size_t w = 0; w < workers; ++w) {
+        batch.queues.push_back(std::make_unique<WorkQueue>());
+    }
+    for (size_t item = 0; item < batch.inputs.size(); ++item) {
+        batch.queues[item % workers]->items.push_back(item);
+    }
+    if (batch.keep_order) {
+        batch.results.resize(batch.inputs.size());
+        batch.finished.assign(batch.inputs.size(), false);
+    }
+    batch.command_hash = &ctx.command_hash;
+
+    std::vector<std::thread> threads;
+    for (size_t w = 1; w < workers; ++w) {
+        threads.emplace_back(worker, std::ref(batch), w);
+    }
+    worker(batch, 0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (batch.stdin_fd != STDIN_FILENO && batch.stdin_fd != -1) {
+        close(batch.stdin_fd);
+    }
+    return std::min(batch.failures.load(), 101);
+}
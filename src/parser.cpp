@@ -1,101 +1,354 @@
 #include "parser.h"
+#include <iterator>
 #include <string>
 #include <vector>
-#include <iostream>
 
-ParsedCommand parse_command(const std::string& input) {
-    ParsedCommand result;
-    std::vector<Command> commands;
-    Command current_command;
-    current_command.is_background = false;
-    std::string token;
-    bool in_token = false;
-    bool parsing_file = false;
-    char redirection_type = 0;
+namespace {
+
+enum class WordTarget {
+    Token,
+    InputFile,
+    OutputFile,
+};
+
+// Writes unquoted words back to back into the arena. Every word is at
+// most as long as its source text and is followed by at least one
+// source byte (or the end), so input.size() + 1 bytes always suffice.
+class WordWriter {
+private:
+    char* out;
+    char* word_start;
+
+public:
+    explicit WordWriter(char* arena) : out(arena), word_start(arena) {}
+    void begin() { word_start = out; }
+    void put(char c) { *out++ = c; }
+    size_t length() const { return out - word_start; }
+    std::string_view finish() {
+        std::string_view word(word_start, out - word_start);
+        *out++ = '\0';
+        return word;
+    }
+};
+
+bool is_operator(char c) {
+    return c == '|' || c == '>' || c == '<' || c == '&' || c == ';' || c == '(' || c == ')';
+}
+
+bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Index of the unescaped '`' closing a backtick substitution opened
+// before i, or npos.
+size_t find_backtick_end(std::string_view input, size_t i) {
+    for (; i < input.size(); ++i) {
+        if (input[i] == '\\') {
+            i++;
+        } else if (input[i] == '`') {
+            return i;
+        }
+    }
+    return std::string_view::npos;
+}
 
-    for (size_t i = 0; i < input.length(); ++i) {
+// Index of the ')' closing a "$(" that ends just before i, or npos.
+// Quotes and nested backticks inside are skipped; '(' and ')' nest, which
+// covers nested $(...) as well.
+size_t find_paren_end(std::string_view input, size_t i) {
+    int depth = 1;
+    for (; i < input.size(); ++i) {
         char c = input[i];
-        if (std::isspace(c)) {
-            if (in_token) {
-                if (parsing_file) {
-                    if (redirection_type == '>') {
-                        current_command.output_file = token;
-                    } else if (redirection_type == '<') {
-                        current_command.input_file = token;
-                    }
-                    parsing_file = false;
-                    redirection_type = 0;
-                } else {
-                    current_command.tokens.push_back(token);
-                }
-                token.clear();
-                in_token = false;
+        if (c == '\\') {
+            i++;
+        } else if (c == '\'') {
+            i = input.find('\'', i + 1);
+            if (i == std::string_view::npos) {
+                return i;
             }
-        } else if (c == '|' || c == '>' || c == '<' || c == '&') {
-            if (in_token) {
-                if (parsing_file) {
-                    if (redirection_type == '>') {
-                        current_command.output_file = token;
-                    } else if (redirection_type == '<') {
-                        current_command.input_file = token;
-                    }
-                    parsing_file = false;
-                } else {
-                    current_command.tokens.push_back(token);
+        } else if (c == '"') {
+            for (i++; i < input.size() && input[i] != '"'; ++i) {
+                if (input[i] == '\\') {
+                    i++;
                 }
-                token.clear();
-                in_token = false;
             }
-            if (c == '|') {
-                if (!current_command.tokens.empty()) {
-                    commands.push_back(current_command);
-                    current_command = Command();
-                    current_command.is_background = false;
-                }
-            } else if (c == '>') {
-                parsing_file = true;
-                redirection_type = '>';
-            } else if (c == '<') {
-                parsing_file = true;
-                redirection_type = '<';
-            } else if (c == '&') {
-                current_command.is_background = true;
+            if (i >= input.size()) {
+                return std::string_view::npos;
             }
-        } else {
-            token += c;
-            in_token = true;
-        }
-    }
-    if (in_token) {
-        if (parsing_file) {
-            if (redirection_type == '>') {
-                current_command.output_file = token;
-            } else if (redirection_type == '<') {
-                current_command.input_file = token;
+        } else if (c == '`') {
+            i = find_backtick_end(input, i + 1);
+            if (i == std::string_view::npos) {
+                return i;
             }
-        } else {
-            current_command.tokens.push_back(token);
+        } else if (c == '(') {
+            depth++;
+        } else if (c == ')' && --depth == 0) {
+            return i;
         }
     }
-    if (!current_command.tokens.empty() || !current_command.output_file.empty() || !current_command.input_file.empty()) {
-        commands.push_back(current_command);
-    }
+    return std::string_view::npos;
+}
+
+} // namespace
 
-    for (const auto& cmd : commands) {
-        if (cmd.tokens.empty()) {
-            std::cerr << "Invalid command\n";
-            result.commands.clear();
-            return result;
+ParsedCommand parse_command(std::string_view input) {
+    // Arena: words, then the source copy, then unescaped backtick bodies.
+    ParsedCommand result;
+    result.arena.reset(new char[3 * input.size() + 1]);
+    char* source = result.arena.get() + input.size() + 1;
+    input.copy(source, input.size());
+    result.text = std::string_view(source, input.size());
+    char* scratch = source + input.size();
+    WordWriter writer(result.arena.get());
+    std::vector<Substitution> pending; // substitutions in the current word
+
+    // A ( ... ) being parsed suspends the pipeline and command holding it.
+    struct Frame {
+        size_t list;
+        Pipeline pipeline;
+        Command command;
+        size_t and_or_start;
+        size_t pipeline_start;
+    };
+    std::vector<Frame> frames;
+    result.lists.emplace_back();
+    size_t list = 0;
+    Pipeline pipeline;
+    Command current_command;
+    size_t and_or_start = 0; // first pipeline of the and-or list being built
+    size_t pipeline_start = std::string_view::npos;
+    size_t word_end = 0; // past the last word or ')': where a pipeline's text ends
+    WordTarget target = WordTarget::Token;
+
+    auto store = [&](std::string_view word) {
+        Substitution::Target kind = Substitution::Token;
+        if (target == WordTarget::InputFile) {
+            current_command.input_file = word;
+            kind = Substitution::InputFile;
+        } else if (target == WordTarget::OutputFile) {
+            current_command.output_file = word;
+            kind = Substitution::OutputFile;
+        } else {
+            current_command.tokens.push_back(word);
+        }
+        for (auto& sub : pending) {
+            sub.target = kind;
+            sub.token = current_command.tokens.size() - 1;
+            current_command.substitutions.push_back(sub);
         }
-        for (const auto& token : cmd.tokens) {
-            if (token.empty() || token.find_first_of("|><&") != std::string::npos) {
-                std::cerr << "Invalid token: " << token << "\n";
-                result.commands.clear();
-                return result;
+        pending.clear();
+        target = WordTarget::Token;
+    };
+    // Records the substitution starting at input[i] ('$' or '`') and
+    // returns the index just past it, or npos if it is unterminated.
+    auto substitute = [&](size_t i, bool quoted) -> size_t {
+        Substitution sub{Substitution::Token, 0, writer.length(), {}, quoted};
+        if (input[i] == '$') {
+            size_t close = find_paren_end(input, i + 2);
+            if (close == std::string_view::npos) {
+                return close;
             }
+            sub.command = result.text.substr(i + 2, close - i - 2);
+            pending.push_back(sub);
+            return close + 1;
+        }
+        size_t close = find_backtick_end(input, i + 1);
+        if (close == std::string_view::npos) {
+            return close;
+        }
+        char* body = scratch;
+        for (size_t j = i + 1; j < close; ++j) {
+            if (input[j] == '\\' && j + 1 < close &&
+                (input[j + 1] == '`' || input[j + 1] == '\\' || input[j + 1] == '$')) {
+                j++;
+            }
+            *scratch++ = input[j];
+        }
+        sub.command = std::string_view(body, scratch - body);
+        pending.push_back(sub);
+        return close + 1;
+    };
+    auto fail = [&](const char* message) {
+        result.error = message;
+        result.lists.clear();
+        return std::move(result);
+    };
+    auto at_pipeline_start = [&]() {
+        return pipeline.commands.empty() && current_command.tokens.empty() && current_command.subshell == 0 &&
+               current_command.input_file.empty() && current_command.output_file.empty();
+    };
+    // Both return false for a stage with nothing to run.
+    auto end_command = [&]() {
+        if (current_command.tokens.empty() && current_command.subshell == 0) {
+            return false;
+        }
+        pipeline.commands.push_back(std::move(current_command));
+        current_command = Command();
+        return true;
+    };
+    auto end_pipeline = [&]() {
+        if (!end_command()) {
+            return false;
+        }
+        pipeline.text = result.text.substr(pipeline_start, word_end - pipeline_start);
+        result.lists[list].push_back(std::move(pipeline));
+        pipeline = Pipeline();
+        pipeline_start = std::string_view::npos;
+        return true;
+    };
+
+    size_t i = 0;
+    while (i < input.size()) {
+        char c = input[i];
+        if (is_space(c)) {
+            i++;
+        } else if (c == '>' || c == '<') {
+            i++;
+            target = c == '>' ? WordTarget::OutputFile : WordTarget::InputFile;
+        } else if (is_operator(c)) {
+            if (target != WordTarget::Token) {
+                return fail("Missing redirection target");
+            }
+            size_t op = i++;
+            bool doubled = (c == '|' || c == '&') && i < input.size() && input[i] == c;
+            if (doubled) {
+                i++;
+            }
+            if (c == '|' && !doubled) {
+                if (!end_command()) {
+                    return fail("Invalid command");
+                }
+            } else if (c == '|' || c == '&' || c == ';') {
+                if (at_pipeline_start() || !end_pipeline()) {
+                    return fail("Invalid command");
+                }
+                std::vector<Pipeline>& pipelines = result.lists[list];
+                if (doubled) {
+                    pipeline.connector = c == '&' ? Connector::IfSuccess : Connector::IfFailure;
+                    continue;
+                }
+                if (c == '&' && pipelines.size() - and_or_start == 1) {
+                    pipelines.back().commands.back().is_background = true;
+                } else if (c == '&') {
+                    // The whole and-or list goes to the background, so it
+                    // has to run in a subshell of its own.
+                    std::vector<Pipeline> body(std::make_move_iterator(pipelines.begin() + and_or_start),
+                                               std::make_move_iterator(pipelines.end()));
+                    pipelines.erase(pipelines.begin() + and_or_start, pipelines.end());
+                    Pipeline wrapper;
+                    const char* first = body.front().text.data();
+                    wrapper.text = std::string_view(first, body.back().text.data() + body.back().text.size() - first);
+                    Command group;
+                    group.subshell = result.lists.size();
+                    group.is_background = true;
+                    wrapper.commands.push_back(std::move(group));
+                    pipelines.push_back(std::move(wrapper));
+                    result.lists.push_back(std::move(body));
+                }
+                and_or_start = result.lists[list].size();
+            } else if (c == '(') {
+                if (!current_command.tokens.empty() || current_command.subshell != 0 ||
+                    !current_command.input_file.empty() || !current_command.output_file.empty()) {
+                    return fail("Invalid command");
+                }
+                if (pipeline_start == std::string_view::npos) {
+                    pipeline_start = op;
+                }
+                frames.push_back(Frame{list, std::move(pipeline), std::move(current_command), and_or_start,
+                                       pipeline_start});
+                list = result.lists.size();
+                result.lists.emplace_back();
+                pipeline = Pipeline();
+                current_command = Command();
+                and_or_start = 0;
+                pipeline_start = std::string_view::npos;
+            } else {
+                if (frames.empty()) {
+                    return fail("Invalid command");
+                }
+                if (at_pipeline_start() ? pipeline.connector != Connector::Always : !end_pipeline()) {
+                    return fail("Invalid command");
+                }
+                if (result.lists[list].empty()) {
+                    return fail("Invalid command");
+                }
+                Frame& frame = frames.back();
+                current_command = std::move(frame.command);
+                current_command.subshell = list;
+                pipeline = std::move(frame.pipeline);
+                list = frame.list;
+                and_or_start = frame.and_or_start;
+                pipeline_start = frame.pipeline_start;
+                frames.pop_back();
+                word_end = i;
+            }
+        } else {
+            if (current_command.subshell != 0 && target == WordTarget::Token) {
+                return fail("Invalid command"); // a word after ( ... )
+            }
+            if (pipeline_start == std::string_view::npos) {
+                pipeline_start = i;
+            }
+            writer.begin();
+            while (i < input.size() && !is_space(input[i]) && !is_operator(input[i])) {
+                if (input[i] == '`' || input.compare(i, 2, "$(") == 0) {
+                    i = substitute(i, false);
+                    if (i == std::string_view::npos) {
+                        return fail("Unterminated command substitution");
+                    }
+                    continue;
+                }
+                char w = input[i++];
+                if (w == '\\') {
+                    if (i < input.size()) {
+                        writer.put(input[i++]);
+                    }
+                } else if (w == '\'') {
+                    size_t close = input.find('\'', i);
+                    if (close == std::string_view::npos) {
+                        return fail("Unterminated quote");
+                    }
+                    for (; i < close; ++i) {
+                        writer.put(input[i]);
+                    }
+                    i++;
+                } else if (w == '"') {
+                    while (i < input.size() && input[i] != '"') {
+                        if (input[i] == '`' || input.compare(i, 2, "$(") == 0) {
+                            i = substitute(i, true);
+                            if (i == std::string_view::npos) {
+                                return fail("Unterminated command substitution");
+                            }
+                            continue;
+                        }
+                        char q = input[i++];
+                        if (q == '\\' && i < input.size() &&
+                            (input[i] == '"' || input[i] == '\\' || input[i] == '$' || input[i] == '`')) {
+                            q = input[i++];
+                        }
+                        writer.put(q);
+                    }
+                    if (i >= input.size()) {
+                        return fail("Unterminated quote");
+                    }
+                    i++;
+                } else {
+                    writer.put(w);
+                }
+            }
+            store(writer.finish());
+            word_end = i;
         }
     }
 
-    result.commands = commands;
+    if (target != WordTarget::Token) {
+        return fail("Missing redirection target");
+    }
+    if (!frames.empty()) {
+        return fail("Missing )");
+    }
+    if (at_pipeline_start() ? pipeline.connector != Connector::Always : !end_pipeline()) {
+        return fail("Invalid command");
+    }
     return result;
 }
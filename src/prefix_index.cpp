@@ -0,0 +1,98 @@
+#include "prefix_index.h"
+
+static const uint32_t no_node = 0;
+
+PrefixIndex::PrefixIndex() {
+    clear();
+}
+
+void PrefixIndex::clear() {
+    nodes.clear();
+    free_nodes.clear();
+    nodes.push_back(Node{0, {}});
+}
+
+uint32_t PrefixIndex::child(uint32_t node, char c) const {
+    for (const auto& edge : nodes[node].children) {
+        if (edge.first == c) {
+            return edge.second;
+        }
+    }
+    return no_node;
+}
+
+uint32_t PrefixIndex::alloc_node(uint64_t seq) {
+    if (!free_nodes.empty()) {
+        uint32_t node = free_nodes.back();
+        free_nodes.pop_back();
+        nodes[node].latest = seq;
+        return node;
+    }
+    nodes.push_back(Node{seq, {}});
+    return static_cast<uint32_t>(nodes.size() - 1);
+}
+
+void PrefixIndex::free_subtree(uint32_t node) {
+    std::vector<uint32_t> stack{node};
+    while (!stack.empty()) {
+        uint32_t current = stack.back();
+        stack.pop_back();
+        for (const auto& edge : nodes[current].children) {
+            stack.push_back(edge.second);
+        }
+        nodes[current].children.clear();
+        free_nodes.push_back(current);
+    }
+}
+
+void PrefixIndex::insert(std::string_view cmd, uint64_t seq) {
+    uint32_t node = 0;
+    nodes[node].latest = seq;
+    for (char c : cmd) {
+        uint32_t next = child(node, c);
+        if (next == no_node) {
+            next = alloc_node(seq);
+            nodes[node].children.emplace_back(c, next);
+        } else {
+            nodes[next].latest = seq;
+        }
+        node = next;
+    }
+}
+
+void PrefixIndex::erase(std::string_view cmd, uint64_t seq) {
+    // A node whose newest entry is the one being evicted has no live
+    // entries left below it, since seq is the oldest live entry.
+    uint32_t node = 0;
+    for (char c : cmd) {
+        uint32_t next = child(node, c);
+        if (next == no_node) {
+            return;
+        }
+        if (nodes[next].latest == seq) {
+            auto& edges = nodes[node].children;
+            for (size_t i = 0; i < edges.size(); ++i) {
+                if (edges[i].first == c) {
+                    edges[i] = edges.back();
+                    edges.pop_back();
+                    break;
+                }
+            }
+            free_subtree(next);
+            return;
+        }
+        node = next;
+    }
+}
+
+bool PrefixIndex::find(std::string_view prefix, uint64_t& seq) const {
+    uint32_t node = 0;
+    for (char c : prefix) {
+        node = child(node, c);
+        if (node == no_node) {
+            return false;
+        }
+    }
+    seq = nodes[node].latest;
+    return true;
+}
@@ -0,0 +1,131 @@
+#include "relay.h"
+#include "io_util.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+
+bool set_pipe_size(int fd, int size) {
+    if (size <= 0) {
+        return true;
+    }
+    return fcntl(fd, F_SETPIPE_SZ, size) != -1;
+}
+
+static bool is_pipe(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+static bool copy_with_buffer(int in_fd, const std::vector<int>& outs) {
+    char buffer[65536];
+    while (true) {
+        ssize_t n = read(in_fd, buffer, sizeof(buffer));
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (n == 0) {
+            return true;
+        }
+        for (int fd : outs) {
+            if (!write_all(fd, buffer, n)) {
+                return false;
+            }
+        }
+    }
+}
+
+// Moves exactly len bytes from the front of pipe_fd to out_fd.
+static bool drain(int pipe_fd, int out_fd, size_t len) {
+    bool use_splice = true;
+    char buffer[65536];
+    while (len > 0) {
+        ssize_t n;
+        if (use_splice) {
+            n = splice(pipe_fd, nullptr, out_fd, nullptr, len, SPLICE_F_MOVE);
+            if (n == -1 && errno == EINVAL) {
+                use_splice = false;
+                continue;
+            }
+        } else {
+            n = read(pipe_fd, buffer, len < sizeof(buffer) ? len : sizeof(buffer));
+            if (n > 0 && !write_all(out_fd, buffer, n)) {
+                return false;
+            }
+        }
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (n == 0) {
+            return false;
+        }
+        len -= n;
+    }
+    return true;
+}
+
+bool relay_fanout(int in_fd, const std::vector<int>& outs) {
+    if (outs.empty() || !is_pipe(in_fd)) {
+        return copy_with_buffer(in_fd, outs);
+    }
+
+    // Scratch pipes as large as the source so a tee into an empty one
+    // always takes everything the first tee saw.
+    int capacity = fcntl(in_fd, F_GETPIPE_SZ);
+    std::vector<int> scratch;
+    bool ok = true;
+    for (size_t i = 0; i + 1 < outs.size() && ok; ++i) {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) == -1) {
+            ok = false;
+            break;
+        }
+        set_pipe_size(fds[1], capacity);
+        scratch.push_back(fds[0]);
+        scratch.push_back(fds[1]);
+    }
+
+    while (ok) {
+        ssize_t n;
+        if (scratch.empty()) {
+            n = splice(in_fd, nullptr, outs[0], nullptr, 1 << 20, SPLICE_F_MOVE);
+            if (n == -1 && errno == EINVAL) {
+                ok = copy_with_buffer(in_fd, outs);
+                break;
+            }
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                ok = n == 0;
+                break;
+            }
+            continue;
+        }
+
+        n = tee(in_fd, scratch[1], static_cast<size_t>(capacity), 0);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            ok = false;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        for (size_t i = 1; i < outs.size() - 1 && ok; ++i) {
+            ssize_t m = tee(in_fd, scratch[2 * i + 1], n, 0);
+            ok = m == n;
+        }
+        for (size_t i = 0; i < outs.size() - 1 && ok; ++i) {
+            ok = drain(scratch[2 * i], outs[i], n);
+        }
+        ok = ok && drain(in_fd, outs.back(), n);
+    }
+
+    for (int fd : scratch) {
+        close(fd);
+    }
+    return ok;
+}
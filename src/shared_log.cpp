@@ -0,0 +1,445 @@
+#include "shared_log.h"
+#include "log.h"
+#include "time_util.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+static const uint64_t log_magic = 0x3130545349485346ULL; // "FSHIST01"
+static const size_t header_bytes = 64;
+static const uint64_t granule = 16;
+static const uint32_t pad_flag = 0x80000000u;
+static const uint64_t min_capacity = 64 * 1024;
+static const uint64_t max_capacity = 1ULL << 30;
+static const uint64_t stall_timeout_ns = 1000ULL * 1000 * 1000;
+
+struct LogHeader {
+    uint64_t magic;
+    uint64_t capacity;
+    // Bytes of the data area handed out so far; it runs past capacity
+    // once the log is full, which is what closes it to appends.
+    uint64_t tail;
+    // In a compacted file, the end of the records copied from the old one.
+    uint64_t resume;
+    uint64_t unused[4];
+};
+static_assert(sizeof(LogHeader) == header_bytes, "the data area starts at 64");
+
+// word is stored last: the length in its low half and a seal derived from
+// the record's offset in the high half. Zero means not yet committed, and
+// stray bytes almost never pass for a record. Padding that fills the end
+// of a full log is a record with pad_flag set and no session.
+struct RecordHeader {
+    uint64_t word;
+    uint64_t session;
+};
+
+static uint32_t seal_for(uint64_t pos, uint32_t length) {
+    uint64_t h = ((pos + 1) * 0x9E3779B97F4A7C15ULL) ^ length;
+    return static_cast<uint32_t>(h >> 32) | 1;
+}
+
+static uint64_t sealed(uint64_t pos, uint32_t length) {
+    return length | static_cast<uint64_t>(seal_for(pos, length)) << 32;
+}
+
+static uint64_t record_bytes(uint64_t length) {
+    return (sizeof(RecordHeader) + length + granule - 1) & ~(granule - 1);
+}
+
+static void commit(char* data, uint64_t pos, uint32_t length) {
+    __atomic_store_n(reinterpret_cast<uint64_t*>(data + pos), sealed(pos, length), __ATOMIC_RELEASE);
+}
+
+// Bytes covered by the committed record or padding at pos, or 0 while it
+// is still being written (or was abandoned).
+static uint64_t committed_span(const char* data, uint64_t pos, uint64_t capacity, uint32_t& length) {
+    uint64_t word = __atomic_load_n(reinterpret_cast<const uint64_t*>(data + pos), __ATOMIC_ACQUIRE);
+    length = static_cast<uint32_t>(word);
+    if (word == 0 || static_cast<uint32_t>(word >> 32) != seal_for(pos, length)) {
+        return 0;
+    }
+    uint64_t span = length & pad_flag ? length & ~pad_flag : record_bytes(length);
+    return span <= capacity - pos ? span : 0;
+}
+
+// Offsets of the committed records in [from, to), stepping over padding
+// and, a granule at a time, over anything uncommitted.
+static std::vector<uint64_t> record_offsets(const char* data, uint64_t from, uint64_t to, uint64_t capacity) {
+    std::vector<uint64_t> offsets;
+    uint64_t pos = from;
+    while (pos < to) {
+        uint32_t length;
+        uint64_t span = committed_span(data, pos, capacity, length);
+        if (span == 0) {
+            pos += granule;
+            continue;
+        }
+        if (!(length & pad_flag)) {
+            offsets.push_back(pos);
+        }
+        pos += span;
+    }
+    return offsets;
+}
+
+struct CopiedRecord {
+    std::string_view text;
+    uint64_t session;
+};
+
+static void keep_newest(std::vector<CopiedRecord>& records, uint64_t budget) {
+    uint64_t used = 0;
+    size_t first = records.size();
+    while (first > 0 && used + record_bytes(records[first - 1].text.size()) <= budget) {
+        used += record_bytes(records[first - 1].text.size());
+        first--;
+    }
+    records.erase(records.begin(), records.begin() + first);
+}
+
+// Writes a complete log holding records to file, for renaming into place.
+static bool write_log(const std::string& file, uint64_t capacity, const std::vector<CopiedRecord>& records) {
+    int fd = open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        return false;
+    }
+    size_t size = header_bytes + capacity;
+    void* mapping = ftruncate(fd, size) == 0 ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                                              : MAP_FAILED;
+    if (mapping == MAP_FAILED) {
+        close(fd);
+        unlink(file.c_str());
+        return false;
+    }
+    char* data = static_cast<char*>(mapping) + header_bytes;
+    uint64_t pos = 0;
+    for (const auto& record : records) {
+        RecordHeader header{sealed(pos, static_cast<uint32_t>(record.text.size())), record.session};
+        memcpy(data + pos, &header, sizeof(header));
+        memcpy(data + pos + sizeof(header), record.text.data(), record.text.size());
+        pos += record_bytes(record.text.size());
+    }
+    LogHeader* header = static_cast<LogHeader*>(mapping);
+    header->magic = log_magic;
+    header->capacity = capacity;
+    header->tail = pos;
+    header->resume = pos;
+    bool ok = msync(mapping, size, MS_SYNC) == 0 && fsync(fd) == 0;
+    munmap(mapping, size);
+    close(fd);
+    if (!ok) {
+        unlink(file.c_str());
+    }
+    return ok;
+}
+
+// Maps an existing log; nullptr if fd does not hold one.
+static char* map_log(int fd, uint64_t& capacity) {
+    struct stat st;
+    LogHeader header;
+    if (fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) < header_bytes ||
+        pread(fd, &header, sizeof(header), 0) != sizeof(header) || header.magic != log_magic ||
+        header.capacity % granule != 0 || header.capacity > static_cast<uint64_t>(st.st_size) - header_bytes) {
+        return nullptr;
+    }
+    void* mapping = mmap(nullptr, header_bytes + header.capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        return nullptr;
+    }
+    capacity = header.capacity;
+    return static_cast<char*>(mapping);
+}
+
+SharedLog::SharedLog()
+    : fd(-1), map(nullptr), capacity(0), inode(0), session(0), read_pos(0), stall_pos(UINT64_MAX), stall_since(0) {}
+
+SharedLog::~SharedLog() {
+    unmap();
+}
+
+void SharedLog::unmap() {
+    if (map) {
+        munmap(map, header_bytes + capacity);
+        map = nullptr;
+    }
+    if (fd != -1) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+// Opens path with its flock held, retrying if the file was replaced while
+// we waited for the lock.
+bool SharedLog::lock_current(int& new_fd) {
+    for (int attempt = 0; attempt < 8; ++attempt) {
+        new_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (new_fd == -1) {
+            return false;
+        }
+        while (flock(new_fd, LOCK_EX) == -1) {
+            if (errno != EINTR) {
+                close(new_fd);
+                return false;
+            }
+        }
+        struct stat by_fd, by_path;
+        if (fstat(new_fd, &by_fd) == 0 && stat(path.c_str(), &by_path) == 0 && by_fd.st_dev == by_path.st_dev &&
+            by_fd.st_ino == by_path.st_ino) {
+            return true;
+        }
+        close(new_fd);
+    }
+    return false;
+}
+
+bool SharedLog::map_current(int new_fd) {
+    uint64_t new_capacity;
+    char* new_map = map_log(new_fd, new_capacity);
+    struct stat st;
+    if (!new_map || fstat(new_fd, &st) == -1) {
+        close(new_fd);
+        return false;
+    }
+    unmap();
+    fd = new_fd;
+    map = new_map;
+    capacity = new_capacity;
+    inode = st.st_ino;
+    return true;
+}
+
+bool SharedLog::open(const std::string& file, size_t wanted) {
+    unmap();
+    path = file;
+    session = (static_cast<uint64_t>(getpid()) << 32) ^ monotonic_ns();
+    read_pos = 0;
+    stall_pos = UINT64_MAX;
+
+    int new_fd;
+    if (!lock_current(new_fd)) {
+        LOG_WARNF("cannot open history file %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    LogHeader header;
+    struct stat st;
+    bool is_log = fstat(new_fd, &st) == 0 && static_cast<size_t>(st.st_size) >= header_bytes &&
+                  pread(new_fd, &header, sizeof(header), 0) == sizeof(header) && header.magic == log_magic;
+    if (!is_log) {
+        // Empty, or plain text from before the shared log: build a log
+        // holding its lines and swap it in while holding the lock.
+        std::string text(st.st_size, '\0');
+        size_t got = 0;
+        while (got < text.size()) {
+            ssize_t n = pread(new_fd, &text[got], text.size() - got, got);
+            if (n <= 0) {
+                break;
+            }
+            got += n;
+        }
+        text.resize(got);
+        std::vector<CopiedRecord> records;
+        uint64_t needed = 0;
+        size_t start = 0;
+        size_t end;
+        // A line without its newline was torn by a crash mid-write.
+        while ((end = text.find('\n', start)) != std::string::npos) {
+            if (end > start) {
+                records.push_back(CopiedRecord{std::string_view(text).substr(start, end - start), 0});
+                needed += record_bytes(end - start);
+            }
+            start = end + 1;
+        }
+        uint64_t new_capacity = std::max<uint64_t>(wanted, needed * 2);
+        new_capacity = std::min(max_capacity, std::max(min_capacity, (new_capacity + granule - 1) & ~(granule - 1)));
+        keep_newest(records, new_capacity / 2);
+        std::string tmp_file = path + ".tmp";
+        if (!write_log(tmp_file, new_capacity, records) || rename(tmp_file.c_str(), path.c_str()) == -1) {
+            LOG_WARNF("cannot create history log %s: %s", path.c_str(), strerror(errno));
+            unlink(tmp_file.c_str());
+            close(new_fd);
+            return false;
+        }
+        close(new_fd);
+        new_fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+        if (new_fd == -1) {
+            return false;
+        }
+    }
+    if (!map_current(new_fd)) {
+        LOG_WARNF("history file %s is not a valid log", path.c_str());
+        return false;
+    }
+    flock(fd, LOCK_UN);
+    return true;
+}
+
+bool SharedLog::try_append(std::string_view text) {
+    LogHeader* header = reinterpret_cast<LogHeader*>(map);
+    char* data = map + header_bytes;
+    uint64_t size = record_bytes(text.size());
+    uint64_t pos = __atomic_fetch_add(&header->tail, size, __ATOMIC_RELAXED);
+    if (pos + size > capacity) {
+        // Whoever straddles the end pads it out, so readers can finish.
+        if (pos < capacity) {
+            commit(data, pos, pad_flag | static_cast<uint32_t>(capacity - pos));
+        }
+        return false;
+    }
+    reinterpret_cast<RecordHeader*>(data + pos)->session = session;
+    memcpy(data + pos + sizeof(RecordHeader), text.data(), text.size());
+    commit(data, pos, static_cast<uint32_t>(text.size()));
+    return true;
+}
+
+void SharedLog::append(std::string_view text) {
+    if (!map) {
+        return;
+    }
+    // A record may fill at most a quarter of the log, so that compaction
+    // always leaves room for it; a longer command grows the log instead.
+    uint64_t needed = record_bytes(text.size()) * 4;
+    if (needed > max_capacity) {
+        LOG_WARNF("command of %zu bytes is too long for history file %s", text.size(), path.c_str());
+        return;
+    }
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        if (needed <= capacity && try_append(text)) {
+            return;
+        }
+        if (!compact(std::max(capacity, needed))) {
+            break;
+        }
+    }
+    LOG_WARNF("cannot append to history file %s", path.c_str());
+}
+
+// The log is full, or too small for the next record. Under its flock, push
+// the tail past capacity so every later reservation fails, let writers
+// that got in before finish, copy the newest records into a new file of
+// new_capacity bytes -- at most half of it -- and rename it over path.
+bool SharedLog::compact(uint64_t new_capacity) {
+    while (flock(fd, LOCK_EX) == -1) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+    struct stat st;
+    if (stat(path.c_str(), &st) == -1 || st.st_ino != inode) {
+        // Another session compacted while we waited for the lock.
+        flock(fd, LOCK_UN);
+        return follow();
+    }
+    LogHeader* header = reinterpret_cast<LogHeader*>(map);
+    char* data = map + header_bytes;
+    uint64_t end = __atomic_fetch_add(&header->tail, capacity, __ATOMIC_ACQ_REL);
+    if (end < capacity) {
+        commit(data, end, pad_flag | static_cast<uint32_t>(capacity - end));
+    }
+    uint64_t deadline = monotonic_ns() + stall_timeout_ns;
+    for (uint64_t pos = 0; pos < capacity;) {
+        uint32_t length;
+        uint64_t span = committed_span(data, pos, capacity, length);
+        if (span != 0) {
+            pos += span;
+        } else if (monotonic_ns() < deadline) {
+            sched_yield();
+        } else {
+            pos += granule;
+        }
+    }
+
+    std::vector<CopiedRecord> records;
+    for (uint64_t pos : record_offsets(data, 0, capacity, capacity)) {
+        const RecordHeader* record = reinterpret_cast<const RecordHeader*>(data + pos);
+        records.push_back(CopiedRecord{
+            std::string_view(data + pos + sizeof(RecordHeader), static_cast<uint32_t>(record->word)), record->session});
+    }
+    keep_newest(records, new_capacity / 2);
+    std::string tmp_file = path + ".tmp";
+    bool ok = write_log(tmp_file, new_capacity, records) && rename(tmp_file.c_str(), path.c_str()) == 0;
+    if (!ok) {
+        LOG_WARNF("cannot compact history file %s: %s", path.c_str(), strerror(errno));
+        unlink(tmp_file.c_str());
+    }
+    flock(fd, LOCK_UN);
+    return ok && follow();
+}
+
+// Moves to the file now at path once this one has been replaced. Records
+// this session had not read yet, if they were carried over, are the last
+// ones before the new file's resume point, so reading continues there.
+bool SharedLog::follow() {
+    struct stat st;
+    if (stat(path.c_str(), &st) == -1 || st.st_ino == inode) {
+        return false;
+    }
+    int new_fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (new_fd == -1) {
+        return false;
+    }
+    uint64_t new_capacity;
+    char* new_map = map_log(new_fd, new_capacity);
+    if (!new_map || fstat(new_fd, &st) == -1) {
+        close(new_fd);
+        return false;
+    }
+    uint64_t tail = __atomic_load_n(&reinterpret_cast<LogHeader*>(map)->tail, __ATOMIC_ACQUIRE);
+    size_t unread = record_offsets(map + header_bytes, read_pos, std::min(tail, capacity), capacity).size();
+    uint64_t resume = reinterpret_cast<LogHeader*>(new_map)->resume;
+    std::vector<uint64_t> copied = record_offsets(new_map + header_bytes, 0, resume, new_capacity);
+
+    unmap();
+    fd = new_fd;
+    map = new_map;
+    capacity = new_capacity;
+    inode = st.st_ino;
+    read_pos = unread == 0 ? resume : unread <= copied.size() ? copied[copied.size() - unread] : 0;
+    stall_pos = UINT64_MAX;
+    return true;
+}
+
+size_t SharedLog::read_new(const std::function<void(std::string_view)>& fn) {
+    size_t count = 0;
+    while (map) {
+        const char* data = map + header_bytes;
+        uint64_t tail = __atomic_load_n(&reinterpret_cast<LogHeader*>(map)->tail, __ATOMIC_ACQUIRE);
+        uint64_t end = std::min(tail, capacity);
+        while (read_pos < end) {
+            uint32_t length;
+            uint64_t span = committed_span(data, read_pos, capacity, length);
+            if (span == 0) {
+                // Reserved but not committed yet; give up on it only if it
+                // stays that way, as when its writer died.
+                uint64_t now = monotonic_ns();
+                if (stall_pos != read_pos) {
+                    stall_pos = read_pos;
+                    stall_since = now;
+                }
+                if (now - stall_since < stall_timeout_ns) {
+                    return count;
+                }
+                read_pos += granule;
+                continue;
+            }
+            const RecordHeader* record = reinterpret_cast<const RecordHeader*>(data + read_pos);
+            if (!(length & pad_flag) && record->session != session) {
+                fn(std::string_view(data + read_pos + sizeof(RecordHeader), length));
+                count++;
+            }
+            read_pos += span;
+        }
+        if (tail < capacity || !follow()) {
+            return count;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,33 @@
+#include "shell_engine.h"
+#include "capture.h"
+#include "parser.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+ShellEngine::ShellEngine() : ctx(false), null_fd(open("/dev/null", O_RDONLY | O_CLOEXEC)) {
+    ctx.stdin_fd = null_fd;
+}
+
+ShellEngine::~ShellEngine() {
+    if (null_fd != -1) {
+        close(null_fd);
+    }
+}
+
+CommandResult ShellEngine::run(std::string_view line) {
+    out_pool.clear();
+    err_pool.clear();
+    int status = run(line, out_pool, err_pool);
+    return CommandResult{status, out_pool, err_pool};
+}
+
+int ShellEngine::run(std::string_view line, std::string& out, std::string& err) {
+    ctx.job_control.reap_jobs();
+    // `exit` ends only the line it is on; the host decides when the
+    // engine is done.
+    ctx.running = true;
+    ParsedCommand parsed = parse_command(line);
+    int status = execute_captured(parsed, ctx, out, &err);
+    ctx.last_status = status;
+    return status;
+}
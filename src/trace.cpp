@@ -0,0 +1,143 @@
+#include "trace.h"
+#include "time_util.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+namespace {
+
+// committed holds seq + 1 once the event numbered seq is fully written:
+// parallel's workers record spawns concurrently with the shell thread,
+// and the dump skips slots still being written. A writer claims its slot
+// by swapping in slot_busy first; one that finds a slot claimed by a
+// writer a whole lap ahead or behind drops its event.
+struct TraceRecord {
+    std::atomic<uint64_t> committed;
+    const char* name;
+    uint64_t start_ns;
+    uint64_t end_ns; // == start_ns for instant events
+    int lane;
+    bool instant;
+    char detail[48];
+};
+
+const size_t ring_capacity = 16384;
+const uint64_t slot_busy = UINT64_MAX;
+TraceRecord ring[ring_capacity];
+std::atomic<uint64_t> ring_head{0}; // total events ever recorded
+
+// Longest prefix of text that fits in limit bytes without splitting a
+// UTF-8 sequence, so the JSON export stays valid.
+size_t utf8_prefix(std::string_view text, size_t limit) {
+    if (text.size() <= limit) {
+        return text.size();
+    }
+    size_t len = limit;
+    while (len > 0 && (static_cast<unsigned char>(text[len]) & 0xC0) == 0x80) {
+        len--;
+    }
+    return len;
+}
+
+void record(const char* name, uint64_t start_ns, uint64_t end_ns, int lane, bool instant, std::string_view detail) {
+    uint64_t seq = ring_head.fetch_add(1, std::memory_order_relaxed);
+    TraceRecord& slot = ring[seq % ring_capacity];
+    uint64_t seen = slot.committed.load(std::memory_order_relaxed);
+    if (seen == slot_busy ||
+        !slot.committed.compare_exchange_strong(seen, slot_busy, std::memory_order_acquire)) {
+        return;
+    }
+    slot.name = name;
+    slot.start_ns = start_ns;
+    slot.end_ns = end_ns;
+    slot.lane = lane;
+    slot.instant = instant;
+    size_t len = utf8_prefix(detail, sizeof(slot.detail) - 1);
+    memcpy(slot.detail, detail.data(), len);
+    slot.detail[len] = '\0';
+    slot.committed.store(seq + 1, std::memory_order_release);
+}
+
+void append_escaped(std::string& out, const char* text) {
+    for (const char* p = text; *p; ++p) {
+        unsigned char c = static_cast<unsigned char>(*p);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += *p;
+        } else if (c < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            out += code;
+        } else {
+            out += *p;
+        }
+    }
+}
+
+} // namespace
+
+bool trace_active = false;
+
+void trace_set_enabled(bool enabled) {
+    trace_active = enabled;
+}
+
+void trace_clear() {
+    for (auto& slot : ring) {
+        slot.committed.store(0, std::memory_order_relaxed);
+    }
+    ring_head.store(0, std::memory_order_release);
+}
+
+size_t trace_size() {
+    return std::min<uint64_t>(ring_head.load(std::memory_order_acquire), ring_capacity);
+}
+
+void trace_span(const char* name, uint64_t start_ns, uint64_t end_ns, int lane, std::string_view detail) {
+    // start_ns is 0 when tracing was switched on mid-span.
+    if (trace_active && start_ns != 0) {
+        record(name, start_ns, end_ns, lane, false, detail);
+    }
+}
+
+void trace_instant(const char* name, int lane, std::string_view detail) {
+    if (trace_active) {
+        uint64_t now = monotonic_ns();
+        record(name, now, now, lane, true, detail);
+    }
+}
+
+void trace_write_json(std::string& out) {
+    int shell_pid = getpid();
+    out += "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    uint64_t head = ring_head.load(std::memory_order_acquire);
+    uint64_t first = head > ring_capacity ? head - ring_capacity : 0;
+    char line[160];
+    bool any = false;
+    for (uint64_t i = first; i < head; ++i) {
+        const TraceRecord& event = ring[i % ring_capacity];
+        if (event.committed.load(std::memory_order_acquire) != i + 1) {
+            continue; // still being written, or already reused
+        }
+        out += any ? ",\n" : "";
+        any = true;
+        int tid = event.lane == 0 ? shell_pid : event.lane;
+        if (event.instant) {
+            snprintf(line, sizeof(line), "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d",
+                     event.name, event.start_ns / 1e3, shell_pid, tid);
+        } else {
+            snprintf(line, sizeof(line), "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+                     event.name, event.start_ns / 1e3, (event.end_ns - event.start_ns) / 1e3, shell_pid, tid);
+        }
+        out += line;
+        if (event.detail[0]) {
+            out += ",\"args\":{\"detail\":\"";
+            append_escaped(out, event.detail);
+            out += "\"}";
+        }
+        out += "}";
+    }
+    out += any ? "\n]}\n" : "]}\n";
+}
@@ -0,0 +1,50 @@
+#include "lexer.h"
+#include <cstdio>
+#include <random>
+#include <string>
+
+static bool same(const LexToken& a, const LexToken& b) {
+    return a.start == b.start && a.end == b.end && a.cls == b.cls && a.state_before == b.state_before &&
+           a.state_after == b.state_after;
+}
+
+// Random edits (insert, delete, replace) over a line built from the
+// characters the lexer treats specially; after each, the incremental
+// result must match lexing the whole line from scratch.
+int main() {
+    static const char alphabet[] = "ab $()|;&\"'><`\\";
+    std::mt19937 rng(6);
+    IncrementalLexer incremental;
+    IncrementalLexer full;
+    std::string line;
+    incremental.reset(line);
+
+    for (int step = 0; step < 300000; ++step) {
+        if (line.size() > 40) {
+            line.clear();
+            incremental.reset(line);
+        }
+        size_t start = rng() % (line.size() + 1);
+        size_t old_len = rng() % 3 == 0 ? 0 : rng() % (line.size() - start + 1) % 4;
+        std::string text(rng() % 4, ' ');
+        for (char& c : text) {
+            c = alphabet[rng() % (sizeof(alphabet) - 1)];
+        }
+        line.replace(start, old_len, text);
+        incremental.update(line, start, old_len, text.size());
+        full.reset(line);
+
+        const auto& got = incremental.get_tokens();
+        const auto& expected = full.get_tokens();
+        bool ok = got.size() == expected.size();
+        for (size_t i = 0; ok && i < got.size(); ++i) {
+            ok = same(got[i], expected[i]);
+        }
+        if (!ok) {
+            fprintf(stderr, "FAIL: step %d, line \"%s\" after replacing %zu bytes at %zu with \"%s\"\n", step,
+                    line.c_str(), old_len, start, text.c_str());
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,303 @@
+#include "parser.h"
+#include <cstdio>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+// Random lines are generated together with the parse they should give:
+// words mixing bare, '...', "..." and backslash-escaped pieces (operators
+// and quotes included) with $(...) and `...` substitutions, redirections,
+// pipelines, && || ; & lists and nested ( ... ) groups.
+
+namespace {
+
+struct ExpectedSub {
+    size_t offset;
+    std::string command;
+    bool quoted;
+};
+
+struct ExpectedWord {
+    std::string value;
+    std::vector<ExpectedSub> subs;
+};
+
+struct ExpectedCommand {
+    std::vector<ExpectedWord> words;
+    ExpectedWord input_file;
+    ExpectedWord output_file;
+    bool is_background = false;
+    size_t subshell = 0;
+};
+
+struct ExpectedPipeline {
+    std::vector<ExpectedCommand> commands;
+    Connector connector = Connector::Always;
+    std::string text;
+};
+
+const char special[] = "ab |&;<>()$`\"'\\#";
+
+struct SubstitutionCase {
+    const char* source;
+    const char* command;
+};
+
+const SubstitutionCase paren_cases[] = {
+    {"echo hi", "echo hi"}, {"a | b", "a | b"}, {"echo $(date)", "echo $(date)"}, {"echo ')'", "echo ')'"},
+    {"(a)", "(a)"},
+};
+const SubstitutionCase backtick_cases[] = {
+    {"echo hi", "echo hi"}, {"echo \\`x\\`", "echo `x`"}, {"a \\$b", "a $b"}, {"a \\\\ b", "a \\ b"},
+};
+
+class Generator {
+public:
+    std::mt19937 rng{9};
+    std::string line;
+    std::vector<std::vector<ExpectedPipeline>> lists;
+
+    void generate() {
+        line.clear();
+        lists.assign(1, {});
+        gen_list(0, 0);
+    }
+
+private:
+    unsigned pick(unsigned n) { return rng() % n; }
+    void spaces() { line.append(pick(2), ' '); }
+    char special_char() { return special[pick(sizeof(special) - 1)]; }
+
+    void gen_substitution(ExpectedWord& word, bool quoted) {
+        if (pick(2) == 0) {
+            const SubstitutionCase& sub = paren_cases[pick(std::size(paren_cases))];
+            line += "$(" + std::string(sub.source) + ")";
+            word.subs.push_back(ExpectedSub{word.value.size(), sub.command, quoted});
+        } else {
+            const SubstitutionCase& sub = backtick_cases[pick(std::size(backtick_cases))];
+            line += "`" + std::string(sub.source) + "`";
+            word.subs.push_back(ExpectedSub{word.value.size(), sub.command, quoted});
+        }
+    }
+
+    ExpectedWord gen_word() {
+        ExpectedWord word;
+        unsigned pieces = 1 + pick(3);
+        for (unsigned piece = 0; piece < pieces; ++piece) {
+            unsigned kind = pick(5);
+            unsigned length = pick(4);
+            if (kind == 0 || (kind == 1 && length == 0)) {
+                line += "x";
+                word.value += "x";
+                for (unsigned i = 0; i < length; ++i) {
+                    char c = "abc=-./"[pick(7)];
+                    line += c;
+                    word.value += c;
+                }
+            } else if (kind == 1) {
+                for (unsigned i = 0; i < length; ++i) {
+                    char c = special_char();
+                    line += '\\';
+                    line += c;
+                    word.value += c;
+                }
+            } else if (kind == 2) {
+                line += '\'';
+                for (unsigned i = 0; i < length; ++i) {
+                    char c = special_char();
+                    c = c == '\'' ? '"' : c;
+                    line += c;
+                    word.value += c;
+                }
+                line += '\'';
+            } else if (kind == 3) {
+                line += '"';
+                for (unsigned i = 0; i < length; ++i) {
+                    if (pick(4) == 0) {
+                        gen_substitution(word, true);
+                        continue;
+                    }
+                    char c = special_char();
+                    if (c == '"' || c == '\\' || c == '$' || c == '`') {
+                        line += '\\';
+                    }
+                    line += c;
+                    word.value += c;
+                }
+                line += '"';
+            } else {
+                gen_substitution(word, false);
+            }
+        }
+        return word;
+    }
+
+    ExpectedCommand gen_command(int depth) {
+        ExpectedCommand command;
+        if (depth < 2 && pick(5) == 0) {
+            command.subshell = lists.size();
+            lists.emplace_back();
+            line += '(';
+            spaces();
+            gen_list(command.subshell, depth + 1);
+            spaces();
+            line += ')';
+        } else {
+            unsigned words = 1 + pick(3);
+            for (unsigned i = 0; i < words; ++i) {
+                if (i > 0) {
+                    line += ' ';
+                }
+                command.words.push_back(gen_word());
+            }
+        }
+        if (pick(4) == 0) {
+            spaces();
+            line += '<';
+            spaces();
+            command.input_file = gen_word();
+        }
+        if (pick(4) == 0) {
+            spaces();
+            line += '>';
+            spaces();
+            command.output_file = gen_word();
+        }
+        return command;
+    }
+
+    ExpectedPipeline gen_pipeline(int depth) {
+        ExpectedPipeline pipeline;
+        size_t start = line.size();
+        unsigned commands = 1 + pick(3);
+        for (unsigned i = 0; i < commands; ++i) {
+            if (i > 0) {
+                spaces();
+                line += '|';
+                spaces();
+            }
+            pipeline.commands.push_back(gen_command(depth));
+        }
+        pipeline.text = line.substr(start);
+        return pipeline;
+    }
+
+    void gen_list(size_t list, int depth) {
+        unsigned and_or_lists = 1 + pick(3);
+        for (unsigned n = 0; n < and_or_lists; ++n) {
+            size_t and_or_start = lists[list].size();
+            size_t text_start = line.size();
+            unsigned pipelines = 1 + pick(2);
+            for (unsigned i = 0; i < pipelines; ++i) {
+                Connector connector = Connector::Always;
+                if (i > 0) {
+                    spaces();
+                    connector = pick(2) == 0 ? Connector::IfSuccess : Connector::IfFailure;
+                    line += connector == Connector::IfSuccess ? "&&" : "||";
+                    spaces();
+                }
+                ExpectedPipeline pipeline = gen_pipeline(depth);
+                pipeline.connector = connector;
+                lists[list].push_back(std::move(pipeline));
+            }
+            std::string and_or_text = line.substr(text_start);
+            bool last = n + 1 == and_or_lists;
+            unsigned end = pick(last ? 3 : 2);
+            if (end == 2) {
+                break;
+            }
+            spaces();
+            line += end == 0 ? ';' : '&';
+            spaces();
+            if (end == 1 && pipelines == 1) {
+                lists[list].back().commands.back().is_background = true;
+            } else if (end == 1) {
+                std::vector<ExpectedPipeline> body(lists[list].begin() + and_or_start, lists[list].end());
+                lists[list].resize(and_or_start);
+                ExpectedPipeline wrapper;
+                wrapper.text = and_or_text;
+                ExpectedCommand group;
+                group.subshell = lists.size();
+                group.is_background = true;
+                wrapper.commands.push_back(group);
+                lists[list].push_back(wrapper);
+                lists.push_back(std::move(body));
+            }
+        }
+    }
+};
+
+bool same_subs(const Command& command, const ExpectedWord& word, Substitution::Target target, size_t token,
+               size_t& next) {
+    for (const auto& expected : word.subs) {
+        if (next >= command.substitutions.size()) {
+            return false;
+        }
+        const Substitution& sub = command.substitutions[next++];
+        if (sub.target != target || (target == Substitution::Token && sub.token != token) ||
+            sub.offset != expected.offset || sub.command != expected.command || sub.quoted != expected.quoted) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool same_command(const Command& command, const ExpectedCommand& expected) {
+    if (command.tokens.size() != expected.words.size() || command.is_background != expected.is_background ||
+        command.subshell != expected.subshell || command.input_file != expected.input_file.value ||
+        command.output_file != expected.output_file.value) {
+        return false;
+    }
+    size_t next = 0;
+    for (size_t i = 0; i < expected.words.size(); ++i) {
+        if (command.tokens[i] != expected.words[i].value ||
+            !same_subs(command, expected.words[i], Substitution::Token, i, next)) {
+            return false;
+        }
+    }
+    return same_subs(command, expected.input_file, Substitution::InputFile, 0, next) &&
+           same_subs(command, expected.output_file, Substitution::OutputFile, 0, next) &&
+           next == command.substitutions.size();
+}
+
+bool same_parse(const ParsedCommand& parsed, const std::vector<std::vector<ExpectedPipeline>>& lists) {
+    if (parsed.error || parsed.lists.size() != lists.size()) {
+        return false;
+    }
+    for (size_t l = 0; l < lists.size(); ++l) {
+        if (parsed.lists[l].size() != lists[l].size()) {
+            return false;
+        }
+        for (size_t p = 0; p < lists[l].size(); ++p) {
+            const Pipeline& pipeline = parsed.lists[l][p];
+            const ExpectedPipeline& expected = lists[l][p];
+            if (pipeline.connector != expected.connector || pipeline.text != expected.text ||
+                pipeline.commands.size() != expected.commands.size()) {
+                return false;
+            }
+            for (size_t c = 0; c < expected.commands.size(); ++c) {
+                if (!same_command(pipeline.commands[c], expected.commands[c])) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main() {
+    Generator generator;
+    for (int step = 0; step < 50000; ++step) {
+        generator.generate();
+        ParsedCommand parsed = parse_command(generator.line);
+        if (!same_parse(parsed, generator.lists)) {
+            fprintf(stderr, "FAIL: step %d: %s%s%s\n", step, generator.line.c_str(), parsed.error ? "\n  error: " : "",
+                    parsed.error ? parsed.error : "");
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include "prefix_index.h"
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <random>
+#include <string>
+
+// Random insert/evict/lookup steps over a small alphabet, so entries share
+// prefixes, checked against a newest-first scan of the live entries.
+int main() {
+    std::mt19937 rng(4);
+    PrefixIndex index;
+    std::deque<std::string> live;
+    uint64_t front_seq = 0;
+    auto random_text = [&rng](size_t max_len) {
+        std::string text(1 + rng() % max_len, ' ');
+        for (char& c : text) {
+            c = "abc"[rng() % 3];
+        }
+        return text;
+    };
+
+    for (int step = 0; step < 200000; ++step) {
+        unsigned op = rng() % 8;
+        if (op < 3) {
+            std::string cmd = random_text(6);
+            index.insert(cmd, front_seq + live.size());
+            live.push_back(cmd);
+        } else if (op < 5 && !live.empty()) {
+            index.erase(live.front(), front_seq);
+            live.pop_front();
+            front_seq++;
+        } else {
+            // As History does: a hit older than the oldest live entry is stale.
+            std::string prefix = random_text(4);
+            uint64_t seq;
+            bool found = index.find(prefix, seq) && seq >= front_seq;
+            bool expected_found = false;
+            uint64_t expected = 0;
+            for (size_t i = live.size(); i-- > 0;) {
+                if (live[i].compare(0, prefix.size(), prefix) == 0) {
+                    expected_found = true;
+                    expected = front_seq + i;
+                    break;
+                }
+            }
+            if (found != expected_found || (found && seq != expected)) {
+                fprintf(stderr, "FAIL: step %d, prefix \"%s\": expected %s%llu, got %s%llu\n", step, prefix.c_str(),
+                        expected_found ? "" : "no match ", static_cast<unsigned long long>(expected),
+                        found ? "" : "no match ", static_cast<unsigned long long>(found ? seq : 0));
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
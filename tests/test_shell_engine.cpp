@@ -0,0 +1,27 @@
+#include "shell_engine.h"
+#include <cstdio>
+#include <string>
+
+static int failures = 0;
+
+static void expect(ShellEngine& engine, const char* line, int status, const char* out) {
+    CommandResult result = engine.run(line);
+    if (result.status != status || result.out != out) {
+        fprintf(stderr, "FAIL: %s\n  expected status %d, out \"%s\"\n  got status %d, out \"%.*s\"\n", line, status,
+                out, result.status, static_cast<int>(result.out.size()), result.out.data());
+        failures++;
+    }
+}
+
+int main() {
+    ShellEngine engine;
+    expect(engine, "true && echo ok", 0, "ok\n");
+    expect(engine, "false || echo fallback; false", 1, "fallback\n");
+    expect(engine, "(echo sub; exit 4) || echo got", 0, "sub\ngot\n");
+
+    // exit ends its own line; the engine keeps running later lines.
+    expect(engine, "echo before; exit 3; echo skipped", 3, "before\n");
+    expect(engine, "echo after-exit", 0, "after-exit\n");
+    expect(engine, "true && echo ok", 0, "ok\n");
+    return failures == 0 ? 0 : 1;
+}